@@ -14,6 +14,7 @@
 #include <QSlider>
 #include <QDial>
 #include <QGridLayout>
+#include <QSignalMapper>
 
 #include <cmath>
 
@@ -21,6 +22,7 @@
 #include "dial_widget.h"
 #include "engine.h"
 #include "assign.h"
+#include "controller_map.h"
 
 struct adsr_widget : public QWidget {
 	Q_OBJECT
@@ -32,19 +34,36 @@ struct adsr_widget : public QWidget {
 	dial_widget *d;
 	dial_widget *s;
 	dial_widget *r;
+
+	QSignalMapper *learn_mapper;
 		
 	public slots:
+		void learn(int parameter) {
+			engine::get()->learn(gen, parameter);
+		}
+
 		void changed(double) {
-			engine::get()->write_command(assign(gen->t.gain, gain->value()));
-			engine::get()->write_command(assign(gen->t.attack_g, a->value()));
-			engine::get()->write_command(assign(gen->t.decay_g, d->value()));
-			engine::get()->write_command(assign(gen->t.sustain_g, s->value()));
-			engine::get()->write_command(assign(gen->t.release_g, r->value()));
-			engine::get()->deferred_commands.write(boost::bind(&adsr_widget::update, this));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.gain, gain->value()));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.attack_g, a->value()));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.decay_g, d->value()));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.sustain_g, s->value()));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.release_g, r->value()));
+			engine::get()->defer(boost::bind(&adsr_widget::update, this));
 		}
 
 
 	public:
+		//! Show a value the engine settled on for parameter (see controller_feedback)
+		void show_parameter(int parameter, double value) {
+			switch (parameter) {
+				case PARAMETER_GAIN: gain->show_value(value); break;
+				case PARAMETER_ATTACK: a->show_value(value); break;
+				case PARAMETER_DECAY: d->show_value(value); break;
+				case PARAMETER_SUSTAIN: s->show_value(value); break;
+				case PARAMETER_RELEASE: r->show_value(value); break;
+			}
+		}
+
 		adsr_widget(disposable_generator_ptr gen, QWidget *parent = 0) :
 			QWidget(parent),
 			gen(gen)
@@ -85,6 +104,15 @@ struct adsr_widget : public QWidget {
 			r->set_max_value(10);
 			connect(r, SIGNAL(valueChanged(double)), this, SLOT(changed(double)));
 
+			learn_mapper = new QSignalMapper(this);
+			dial_widget *dials[] = { gain, a, d, s, r };
+			const int parameters[] = { PARAMETER_GAIN, PARAMETER_ATTACK, PARAMETER_DECAY, PARAMETER_SUSTAIN, PARAMETER_RELEASE };
+			for (unsigned int index = 0; index < 5; ++index) {
+				learn_mapper->setMapping(dials[index], parameters[index]);
+				connect(dials[index], SIGNAL(learn_requested()), learn_mapper, SLOT(map()));
+			}
+			connect(learn_mapper, SIGNAL(mapped(int)), this, SLOT(learn(int)));
+
 			QGridLayout *layout = new QGridLayout();
 			layout->addWidget(gain, 0, 0);
 			layout->addWidget(a, 0, 1);
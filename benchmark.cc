@@ -0,0 +1,389 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstring>
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+
+#include <boost/program_options.hpp>
+
+#include "engine_core.h"
+#include "synthetic.h"
+
+/**
+	Drives engine_core headlessly (no JACK, no Qt) with synthetic setups and
+	dense synthetic MIDI and prints one CSV line per configuration. See
+	--help for the swept parameters.
+
+	ns_per_voice_frame is the process time per frame of a playing voice, i.e.
+	what a voice costs including the envelope, the voice allocation and the
+	mixing. With -p 128 -g 100 -s 1 -n 256 --seconds 4 (about 134 voices
+	playing) on one core of a 2.1 GHz Xeon, -i sweeping the
+	interpolations gave:
+
+	                 mono   stereo
+	    linear        9.0      9.8
+	    cubic        11.5     14.6
+	    sinc8        14.3     18.0
+	    sinc16       16.7     21.8
+	    sinc32       23.1     31.4
+*/
+
+namespace po = boost::program_options;
+
+static uint64_t now_ns() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//! Counts the cache misses of the calling thread. Reads -1 if perf events are not available
+struct cache_miss_counter {
+	int fd;
+
+	cache_miss_counter() {
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+
+	~cache_miss_counter() {
+		if (fd >= 0) close(fd);
+	}
+
+	int64_t read_count() {
+		if (fd < 0) return -1;
+		int64_t count = 0;
+		if (read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+		return count;
+	}
+};
+
+struct configuration {
+	unsigned int polyphony;
+	unsigned int generators;
+	unsigned int samples;
+	unsigned int period;
+	unsigned int threads;
+
+	double sample_seconds;
+	double looping;
+	unsigned int channels;
+	double notes_per_second;
+	double seconds;
+	double sample_rate;
+	bool sort_voices;
+	int interpolation;
+};
+
+//! One engine and the synthetic MIDI to drive it with
+struct instance {
+	const configuration &c;
+	engine_core core;
+	lcg random;
+
+	std::vector<float> out_0;
+	std::vector<float> out_1;
+
+	//! The synthetic MIDI events are written to these
+	std::vector<jack_midi_event_t> events;
+	std::vector<unsigned char> event_data;
+
+	struct held_note {
+		jack_nframes_t off_frame;
+		unsigned char channel;
+		unsigned char note;
+	};
+	std::vector<held_note> held;
+
+	//! Results
+	uint64_t process_ns;
+	uint64_t max_process_ns;
+	uint64_t frames;
+	uint64_t callbacks;
+	uint64_t voice_frames;
+	int64_t cache_misses;
+
+	instance(const configuration &c, const std::vector<disposable_sample_ptr> &samples, uint32_t seed) :
+		c(c),
+		core(c.sample_rate),
+		random(seed),
+		out_0(c.period),
+		out_1(c.period),
+		events(4096),
+		event_data(3 * 4096),
+		process_ns(0),
+		max_process_ns(0),
+		frames(0),
+		callbacks(0),
+		voice_frames(0),
+		cache_misses(0)
+	{
+		held.reserve(65536);
+
+		//! Generators are spread over all channels and notes, one note each
+		disposable_generator_vector_ptr gens = disposable_generator_vector::create(generator_vector());
+		for (unsigned int index = 0; index < c.generators; ++index) {
+			std::stringstream name;
+			name << "generator " << index;
+
+			disposable_generator_ptr g = disposable_generator::create(generator(name.str(), samples[index % samples.size()]));
+			g->t.channel = (index / 128) % 16;
+			g->t.note = g->t.min_note = g->t.max_note = index % 128;
+			g->t.looping = random.below(1000) < c.looping * 1000;
+			g->t.loop_start = 0.25;
+			g->t.loop_end = 0.75;
+			g->t.release_g = 0.1;
+			g->t.interpolation = c.interpolation;
+			g->t.update();
+			gens->t.push_back(g);
+		}
+
+		//! Nothing runs yet, so set things directly instead of through commands
+		core.gens = gens;
+		core.set_voices(engine_core::create_voices(c.polyphony), c.polyphony);
+		core.sort_voices = c.sort_voices;
+	}
+
+	//! Fill events with the note ons and offs of the period starting at frame_time
+	unsigned int make_events(jack_nframes_t frame_time) {
+		unsigned int count = 0;
+
+		//! Note offs first, they are sorted by time within the period below
+		for (unsigned int index = 0; index < held.size() && count < events.size();) {
+			if (held[index].off_frame < frame_time + c.period) {
+				add_event(count, held[index].off_frame - std::min(held[index].off_frame, frame_time), 0x80 | held[index].channel, held[index].note, 0);
+				held[index] = held.back();
+				held.pop_back();
+			} else {
+				++index;
+			}
+		}
+
+		const double expected = c.notes_per_second * c.period / c.sample_rate;
+		unsigned int notes = (unsigned int)expected;
+		if (random.below(1000) < (expected - notes) * 1000) ++notes;
+
+		const unsigned int used_channels = std::min(16u, (c.generators + 127) / 128);
+		for (unsigned int note = 0; note < notes && count < events.size() && held.size() < held.capacity(); ++note) {
+			held_note h;
+			h.channel = random.below(used_channels);
+			h.note = random.below(128);
+			h.off_frame = frame_time + c.period + random.below((jack_nframes_t)(c.sample_rate / 2));
+			held.push_back(h);
+			add_event(count, random.below(c.period), 0x90 | h.channel, h.note, 1 + random.below(127));
+		}
+
+		//! Insertion sort by time, there are not many
+		for (unsigned int i = 1; i < count; ++i) {
+			for (unsigned int j = i; j > 0 && events[j].time < events[j - 1].time; --j) {
+				std::swap(events[j], events[j - 1]);
+			}
+		}
+
+		return count;
+	}
+
+	void add_event(unsigned int &count, jack_nframes_t time, unsigned char status, unsigned char data_1, unsigned char data_2) {
+		unsigned char *data = &event_data[3 * count];
+		data[0] = status;
+		data[1] = data_1;
+		data[2] = data_2;
+		events[count].time = time;
+		events[count].size = 3;
+		events[count].buffer = data;
+		++count;
+	}
+
+	void run() {
+		cache_miss_counter counter;
+		const int64_t misses_before = counter.read_count();
+
+		const uint64_t total_frames = (uint64_t)(c.seconds * c.sample_rate);
+		jack_nframes_t frame_time = 0;
+
+		while (frames < total_frames) {
+			const unsigned int count = make_events(frame_time);
+
+			const uint64_t begin = now_ns();
+			core.process(&out_0[0], &out_1[0], &events[0], count, c.period, frame_time, (jack_nframes_t)c.sample_rate);
+			const uint64_t duration = now_ns() - begin;
+
+			process_ns += duration;
+			max_process_ns = std::max(max_process_ns, duration);
+			frames += c.period;
+			++callbacks;
+			frame_time += c.period;
+
+			for (unsigned int index = 0; index < core.voices->t.size(); ++index) {
+				if (core.voices->t.active(index)) voice_frames += c.period;
+			}
+		}
+
+		const int64_t misses_after = counter.read_count();
+		cache_misses = (misses_before < 0 || misses_after < 0) ? -1 : misses_after - misses_before;
+	}
+
+	static void *run_thread(void *arg) {
+		((instance*)arg)->run();
+		return 0;
+	}
+};
+
+static long peak_rss_kb() {
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+static disposable_sample_ptr make_sample(unsigned int index, const configuration &c, lcg &random) {
+	std::stringstream name;
+	name << "synthetic " << index;
+
+	const double frequency = 110.0 * pow(2.0, (index % 48) / 12.0);
+	return synthetic_sample(name.str(), (unsigned int)(c.sample_seconds * c.sample_rate), c.channels, frequency, c.sample_rate, random);
+}
+
+static void run(const configuration &c) {
+	lcg random(4711);
+
+	//! 0 samples means one per generator
+	const unsigned int sample_count = (c.samples == 0) ? c.generators : std::min(c.samples, c.generators);
+	std::vector<disposable_sample_ptr> samples;
+	for (unsigned int index = 0; index < sample_count; ++index) {
+		samples.push_back(make_sample(index, c, random));
+	}
+
+	//! All disposables are created here, the threads only call process()
+	std::vector<instance*> instances;
+	for (unsigned int index = 0; index < c.threads; ++index) {
+		instances.push_back(new instance(c, samples, 1 + index));
+	}
+
+	std::vector<pthread_t> threads(c.threads);
+	for (unsigned int index = 0; index < c.threads; ++index) {
+		pthread_create(&threads[index], 0, &instance::run_thread, instances[index]);
+	}
+
+	uint64_t process_ns = 0, max_process_ns = 0, frames = 0, voice_frames = 0;
+	int64_t cache_misses = 0;
+	for (unsigned int index = 0; index < c.threads; ++index) {
+		pthread_join(threads[index], 0);
+		process_ns += instances[index]->process_ns;
+		max_process_ns = std::max(max_process_ns, instances[index]->max_process_ns);
+		frames += instances[index]->frames;
+		voice_frames += instances[index]->voice_frames;
+		if (cache_misses >= 0) cache_misses = (instances[index]->cache_misses < 0) ? -1 : cache_misses + instances[index]->cache_misses;
+	}
+
+	const double period_ns = 1e9 * c.period / c.sample_rate;
+	const double ns_per_frame = (double)process_ns / frames;
+
+	std::cout
+		<< c.polyphony << ","
+		<< c.generators << ","
+		<< sample_count << ","
+		<< c.period << ","
+		<< c.threads << ","
+		<< c.channels << ","
+		<< c.looping << ","
+		<< (c.sort_voices ? "sorted" : "slot") << ","
+		<< interpolation_names[c.interpolation] << ","
+		<< ns_per_frame << ","
+		<< (voice_frames > 0 ? (double)process_ns / voice_frames : 0.0) << ","
+		<< ns_per_frame * c.period / period_ns << ","
+		<< max_process_ns / period_ns << ","
+		<< (double)voice_frames / frames << ","
+		<< (cache_misses < 0 ? -1.0 : (double)cache_misses / frames) << ","
+		<< peak_rss_kb()
+		<< std::endl;
+
+	for (unsigned int index = 0; index < instances.size(); ++index) {
+		delete instances[index];
+	}
+	samples.clear();
+	heap::get()->cleanup();
+}
+
+int main(int argc, char **argv) {
+	std::vector<unsigned int> polyphonies, generator_counts, sample_counts, periods, thread_counts;
+	configuration c;
+	std::string voice_order;
+	std::vector<std::string> interpolation_names_;
+	std::vector<int> interpolations;
+
+	po::options_description desc("Allowed options:");
+	desc.add_options()
+		("help,h", "Produce this help message")
+		("polyphony,p", po::value<std::vector<unsigned int> >(&polyphonies)->multitoken(), "Polyphonies to sweep (default 32 64 128 256 512 1024 2048)")
+		("generators,g", po::value<std::vector<unsigned int> >(&generator_counts)->multitoken(), "Generator counts to sweep (default 10 100 1000 10000)")
+		("samples,s", po::value<std::vector<unsigned int> >(&sample_counts)->multitoken(), "Numbers of distinct samples the generators share, 0 means one per generator (default 1 0)")
+		("period,n", po::value<std::vector<unsigned int> >(&periods)->multitoken(), "Period sizes to sweep (default 16 64 256 1024 4096)")
+		("threads,t", po::value<std::vector<unsigned int> >(&thread_counts)->multitoken(), "Numbers of engines running in parallel threads to sweep (default 1)")
+		("sample-seconds", po::value<double>(&c.sample_seconds)->default_value(2.0), "Length of the synthetic samples")
+		("looping", po::value<double>(&c.looping)->default_value(0.5), "Fraction of looping generators")
+		("channels", po::value<unsigned int>(&c.channels)->default_value(1), "Channels of the synthetic samples (1 or 2)")
+		("notes-per-second", po::value<double>(&c.notes_per_second)->default_value(2000), "Rate of the synthetic note ons")
+		("seconds", po::value<double>(&c.seconds)->default_value(2.0), "Audio time to render per configuration")
+		("sample-rate", po::value<double>(&c.sample_rate)->default_value(48000), "Sample rate")
+		("voice-order", po::value<std::string>(&voice_order)->default_value("sorted"), "Render voices \"sorted\" by sample or in \"slot\" order")
+		("interpolation,i", po::value<std::vector<std::string> >(&interpolation_names_)->multitoken(), "Interpolations of the generators to sweep: linear, cubic, sinc8, sinc16, sinc32 (default linear)")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) { std::cout << desc << std::endl; return 0; }
+
+	if (polyphonies.empty()) for (unsigned int p = 32; p <= 2048; p *= 2) polyphonies.push_back(p);
+	if (generator_counts.empty()) for (unsigned int g = 10; g <= 10000; g *= 10) generator_counts.push_back(g);
+	if (sample_counts.empty()) { sample_counts.push_back(1); sample_counts.push_back(0); }
+	if (periods.empty()) for (unsigned int n = 16; n <= 4096; n *= 4) periods.push_back(n);
+	if (thread_counts.empty()) thread_counts.push_back(1);
+	if (interpolation_names_.empty()) interpolation_names_.push_back(interpolation_names[LINEAR_INTERPOLATION]);
+
+	for (unsigned int index = 0; index < interpolation_names_.size(); ++index) {
+		interpolations.push_back(interpolation_of_name(interpolation_names_[index]));
+		if (interpolations.back() < 0) {
+			std::cerr << "Unknown interpolation: " << interpolation_names_[index] << std::endl;
+			return 1;
+		}
+	}
+
+	c.sort_voices = voice_order != "slot";
+
+	std::cout << "polyphony,generators,samples,period,threads,channels,looping,voice_order,interpolation,ns_per_frame,ns_per_voice_frame,load,max_load,average_voices,cache_misses_per_frame,peak_rss_kb" << std::endl;
+
+	for (unsigned int p = 0; p < polyphonies.size(); ++p)
+	for (unsigned int g = 0; g < generator_counts.size(); ++g)
+	for (unsigned int s = 0; s < sample_counts.size(); ++s)
+	for (unsigned int n = 0; n < periods.size(); ++n)
+	for (unsigned int t = 0; t < thread_counts.size(); ++t)
+	for (unsigned int i = 0; i < interpolations.size(); ++i) {
+		c.polyphony = polyphonies[p];
+		c.generators = generator_counts[g];
+		c.samples = sample_counts[s];
+		c.period = periods[n];
+		c.threads = thread_counts[t];
+		c.interpolation = interpolations[i];
+		run(c);
+	}
+
+	delete heap::get();
+	return 0;
+}
@@ -0,0 +1,97 @@
+#ifndef JASS_CHANNEL_STATE_HH
+#define JASS_CHANNEL_STATE_HH
+
+#include <stdint.h>
+
+//! A set of MIDI notes (0 - 127)
+struct note_set {
+	uint64_t words[2];
+
+	note_set() {
+		clear();
+	}
+
+	void clear() {
+		words[0] = words[1] = 0;
+	}
+
+	inline void set(unsigned int note) {
+		words[(note >> 6) & 1] |= (uint64_t)1 << (note & 63);
+	}
+
+	inline void reset(unsigned int note) {
+		words[(note >> 6) & 1] &= ~((uint64_t)1 << (note & 63));
+	}
+
+	inline bool test(unsigned int note) const {
+		return (words[(note >> 6) & 1] >> (note & 63)) & 1;
+	}
+
+	inline bool empty() const {
+		return (words[0] | words[1]) == 0;
+	}
+
+	//! Removes the lowest note from the set and returns it. Only call this on a non-empty set
+	inline unsigned int pop() {
+		const unsigned int word = (words[0] != 0) ? 0 : 1;
+		const unsigned int bit = __builtin_ctzll(words[word]);
+		words[word] &= words[word] - 1;
+		return (word << 6) | bit;
+	}
+
+	inline note_set operator|(const note_set &other) const {
+		note_set s;
+		s.words[0] = words[0] | other.words[0];
+		s.words[1] = words[1] | other.words[1];
+		return s;
+	}
+
+	inline note_set operator&(const note_set &other) const {
+		note_set s;
+		s.words[0] = words[0] & other.words[0];
+		s.words[1] = words[1] & other.words[1];
+		return s;
+	}
+
+	inline note_set operator~() const {
+		note_set s;
+		s.words[0] = ~words[0];
+		s.words[1] = ~words[1];
+		return s;
+	}
+};
+
+/**
+	The key and pedal state of a MIDI channel. Only used in the process thread.
+*/
+struct channel_state {
+	//! Keys which are physically down
+	note_set held;
+
+	//! Keys which were released while a pedal kept their voices playing
+	note_set sustained;
+
+	//! Keys which were held when the sostenuto pedal went down
+	note_set sostenuto_keys;
+
+	bool sustain_pedal;
+	bool sostenuto_pedal;
+
+	//! The current pitch bend in cents
+	int pitch_bend;
+
+	channel_state() :
+		sustain_pedal(false),
+		sostenuto_pedal(false),
+		pitch_bend(0)
+	{
+
+	}
+
+	//! Whether a note off for note has to wait for a pedal
+	inline bool pedal_holds(unsigned int note) const {
+		return sustain_pedal || (sostenuto_pedal && sostenuto_keys.test(note));
+	}
+};
+
+#endif
@@ -2,10 +2,11 @@
 #define JASS_COMMAND_QUEUE_HH
 
 #include <boost/function.hpp>
-#include <QApplication>
+#include <cassert>
 #include <iostream>
 
 #include "ringbuffer.h"
+#include "event_fd.h"
 
 typedef ringbuffer<boost::function<void(void)> > command_ringbuffer;
 
@@ -20,6 +21,9 @@ struct command_queue {
 	command_ringbuffer deferred_commands;
 	int outstanding_acks;
 
+	//! Signalled by the engine after it wrote acknowledgements. The GUI watches this (see notified_functor) and calls check_acknowledgements()
+	event_fd ack_event;
+
 	//! Write command without blocking the GUI
 	void write_command(boost::function<void(void)> f) {
 		if (commands.can_write()) {
@@ -39,7 +43,16 @@ struct command_queue {
 	}
 
 
+	//! Queue a command to be run in the GUI thread as soon as all outstanding commands are acknowledged
+	void defer(boost::function<void(void)> f) {
+		deferred_commands.write(f);
+		//! Wake up check_acknowledgements() in case there is nothing outstanding
+		ack_event.signal();
+	}
+
 	void check_acknowledgements() {
+		ack_event.drain();
+
 		while(acknowledgements.can_read()) { 
 			acknowledgements.read(); 
 			--outstanding_acks; 
@@ -55,7 +68,6 @@ struct command_queue {
 
 //			setEnabled(true);
 		}
-		QApplication::processEvents();
 	}
 
 
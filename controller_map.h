@@ -0,0 +1,204 @@
+#ifndef JASS_CONTROLLER_MAP_HH
+#define JASS_CONTROLLER_MAP_HH
+
+#include <jack/jack.h>
+#include <jack/ringbuffer.h>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+
+#include "disposable.h"
+#include "generator.h"
+#include "event_fd.h"
+#include "memory_usage.h"
+
+//! The generator parameters a MIDI controller can be mapped to
+enum controller_parameter {
+	PARAMETER_GAIN,
+	PARAMETER_ATTACK,
+	PARAMETER_DECAY,
+	PARAMETER_SUSTAIN,
+	PARAMETER_RELEASE,
+	PARAMETER_VELOCITY_FACTOR,
+	PARAMETER_TUNE,
+	PARAMETER_FILTER_CUTOFF,
+	PARAMETER_FILTER_Q,
+	NUMBER_OF_CONTROLLER_PARAMETERS
+};
+
+//! As used in the setup files
+static const char * const controller_parameter_names[NUMBER_OF_CONTROLLER_PARAMETERS] = {
+	"gain", "attack", "decay", "sustain", "release", "velocity-factor", "tune", "filter-cutoff", "filter-q"
+};
+
+enum controller_curve { CURVE_LINEAR, CURVE_EXPONENTIAL, NUMBER_OF_CONTROLLER_CURVES };
+
+static const char * const controller_curve_names[NUMBER_OF_CONTROLLER_CURVES] = { "linear", "exponential" };
+
+inline double &controller_parameter_of(generator &g, int parameter) {
+	switch (parameter) {
+		case PARAMETER_ATTACK: return g.attack_g;
+		case PARAMETER_DECAY: return g.decay_g;
+		case PARAMETER_SUSTAIN: return g.sustain_g;
+		case PARAMETER_RELEASE: return g.release_g;
+		case PARAMETER_VELOCITY_FACTOR: return g.velocity_factor;
+		case PARAMETER_TUNE: return g.tune;
+		case PARAMETER_FILTER_CUTOFF: return g.filter_cutoff;
+		case PARAMETER_FILTER_Q: return g.filter_q;
+		case PARAMETER_GAIN:
+		default:
+			return g.gain;
+	}
+}
+
+//! The range and curve a freshly learned mapping gets, matching the widgets
+inline void controller_parameter_defaults(int parameter, double &min, double &max, int &curve) {
+	static const double ranges[NUMBER_OF_CONTROLLER_PARAMETERS][2] = {
+		{ JASS_ADSR_LIMIT, 0 },
+		{ 0.001, 3 },
+		{ 0.001, 3 },
+		{ JASS_ADSR_LIMIT, 0 },
+		{ 0.001, 10 },
+		{ 0, 2 },
+		{ -100, 100 },
+		{ 20, 20000 },
+		{ 0.5, 20 }
+	};
+
+	min = ranges[parameter][0];
+	max = ranges[parameter][1];
+	curve = (parameter == PARAMETER_FILTER_CUTOFF) ? CURVE_EXPONENTIAL : CURVE_LINEAR;
+}
+
+/**
+	Maps a MIDI controller of a channel to a parameter of a generator. The
+	generator pointer keeps the generator alive as long as the mapping table
+	is, the process thread only ever dereferences it.
+*/
+struct controller_mapping {
+	unsigned int channel;
+	unsigned int controller;
+	disposable_generator_ptr gen;
+	int parameter;
+	double min;
+	double max;
+	int curve;
+
+	//! The process thread moves current towards target, see controller_map::advance()
+	double target;
+	double current;
+	bool settled;
+
+	controller_mapping(
+		unsigned int channel,
+		unsigned int controller,
+		disposable_generator_ptr gen,
+		int parameter,
+		double min,
+		double max,
+		int curve = CURVE_LINEAR
+	) :
+		channel(channel),
+		controller(controller),
+		gen(gen),
+		parameter(parameter),
+		min(min),
+		max(max),
+		curve(curve),
+		target(controller_parameter_of(gen->t, parameter)),
+		current(target),
+		settled(true)
+	{
+
+	}
+
+	//! The parameter value for a controller value (0 - 127)
+	inline double value_of(unsigned int value) const {
+		const double x = (double)std::min(value, 127u) / 127.0;
+		if (curve == CURVE_EXPONENTIAL && min > 0 && max > 0) return min * pow(max / min, x);
+		return min + x * (max - min);
+	}
+};
+
+typedef std::vector<controller_mapping> controller_mapping_vector;
+
+inline size_t disposable_memory(const controller_mapping_vector &v) {
+	return sizeof(controller_mapping_vector) + vector_memory(v);
+}
+typedef disposable<controller_mapping_vector> disposable_controller_map;
+typedef boost::shared_ptr<disposable_controller_map> disposable_controller_map_ptr;
+
+/**
+	What the process thread tells the GUI about controllers: a mapped parameter
+	settled on a new value, or a controller was moved while learning. Works like
+	rt_log: fixed size records through a jack ringbuffer and an event_fd.
+*/
+struct controller_feedback {
+	enum kind { PARAMETER_CHANGED, CONTROLLER_LEARNED };
+
+	struct record {
+		int kind;
+		unsigned int generator_id;
+		int parameter;
+		unsigned int channel;
+		unsigned int controller;
+		double value;
+	};
+
+	jack_ringbuffer_t *jack_ringbuffer;
+	event_fd event;
+	bool dirty;
+
+	controller_feedback(unsigned int size = 256) :
+		dirty(false)
+	{
+		jack_ringbuffer = jack_ringbuffer_create(sizeof(record) * size);
+	}
+
+	~controller_feedback() {
+		jack_ringbuffer_free(jack_ringbuffer);
+	}
+
+	//! Only call this in the process thread. Drops the record if the GUI is behind
+	void write(int kind, unsigned int generator_id, int parameter, unsigned int channel, unsigned int controller, double value) {
+		if (jack_ringbuffer_write_space(jack_ringbuffer) < sizeof(record)) return;
+
+		record r;
+		r.kind = kind;
+		r.generator_id = generator_id;
+		r.parameter = parameter;
+		r.channel = channel;
+		r.controller = controller;
+		r.value = value;
+		jack_ringbuffer_write(jack_ringbuffer, (const char*)&r, sizeof(record));
+		dirty = true;
+	}
+
+	//! Call this once at the end of the process callback
+	void flush() {
+		if (!dirty) return;
+		dirty = false;
+		event.signal();
+	}
+
+	//! Only call this in the GUI thread
+	void drain(boost::function<void(const record&)> sink) {
+		event.drain();
+
+		record r;
+		while (jack_ringbuffer_read_space(jack_ringbuffer) >= sizeof(record)) {
+			jack_ringbuffer_read(jack_ringbuffer, (char*)&r, sizeof(record));
+			sink(r);
+		}
+	}
+
+	private:
+		controller_feedback(const controller_feedback&);
+		controller_feedback &operator=(const controller_feedback&);
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef JASS_CPU_STATS_HH
+#define JASS_CPU_STATS_HH
+
+#include <stdint.h>
+
+#include "trace.h"
+
+/**
+	Where the process thread spends its time. Cycle counts (see trace::now())
+	are added up per generator render call and per period. Only the process
+	thread writes the totals, the GUI reads them now and then and takes the
+	differences, so no locking is needed.
+
+	Counting is only compiled in if JASS_CPU_STATS is defined (cmake
+	-DJASS_CPU_STATS=1), otherwise all counting methods are empty and the
+	totals stay 0.
+*/
+struct cpu_counter {
+	//! Cycles spent rendering
+	volatile uint64_t ticks;
+
+	//! Frames rendered by all voices together, for the cost per voice
+	volatile uint64_t voice_frames;
+
+	cpu_counter() :
+		ticks(0),
+		voice_frames(0)
+	{
+
+	}
+
+	//! Returns the start of a measurement. Costs nothing if the stats are not compiled in
+	static inline uint64_t begin() {
+#ifdef JASS_CPU_STATS
+		return trace::now();
+#else
+		return 0;
+#endif
+	}
+
+	//! Add the time since begin (taken with begin()) spent on frames frames
+	inline void add(uint64_t begin, unsigned int frames) {
+#ifdef JASS_CPU_STATS
+		ticks += trace::now() - begin;
+		voice_frames += frames;
+#else
+		(void)begin; (void)frames;
+#endif
+	}
+};
+
+//! The totals of the process callback. frames counts the periods' frames, not the voices'
+struct cpu_stats {
+	cpu_counter process;
+
+	//! The calibration of the cycle counter, for converting ticks to time in the GUI
+	uint64_t calibration_ticks;
+	uint64_t calibration_ns;
+
+	cpu_stats() :
+		calibration_ticks(trace::now()),
+		calibration_ns(trace::monotonic_ns())
+	{
+
+	}
+
+	//! Only call this in the GUI thread
+	double ticks_per_ns() const {
+		const uint64_t ns = trace::monotonic_ns() - calibration_ns;
+		return ns > 0 ? (double)(trace::now() - calibration_ticks) / (double)ns : 1.0;
+	}
+};
+
+#endif
@@ -14,12 +14,16 @@ struct dial_widget : public QWidget {
 
 	double min_val, max_val, val;
 
+	//! True while the user drags the dial with the left button, see show_value()
+	bool turning;
+
 	public:
 		dial_widget(QWidget *parent = 0) :
 			QWidget(parent),
 			min_val(0),
 			max_val(1),
-			val(0)
+			val(0),
+			turning(false)
 		{
 
 		}
@@ -68,6 +72,28 @@ struct dial_widget : public QWidget {
 			update();
 		}
 
+		//! Like set_value() for values changed elsewhere (e.g. by a MIDI controller). Ignored while the user turns the dial
+		void show_value(double v) {
+			if (turning) return;
+			set_value(v);
+		}
+
+		//! A right click asks for a MIDI controller to be learned for this dial
+		void mousePressEvent(QMouseEvent *e) {
+			if (e->button() == Qt::RightButton) {
+				emit learn_requested();
+				e->accept();
+				return;
+			}
+			if (e->button() == Qt::LeftButton) turning = true;
+			QWidget::mousePressEvent(e);
+		}
+
+		void mouseReleaseEvent(QMouseEvent *e) {
+			if (e->button() == Qt::LeftButton) turning = false;
+			QWidget::mouseReleaseEvent(e);
+		}
+
 		void mouseMoveEvent(QMouseEvent *e) {
 			if (e->buttons() & Qt::LeftButton) {
 				QRect r(0,0, 0, 0);
@@ -100,6 +126,7 @@ struct dial_widget : public QWidget {
 		}
 	signals:
 		void valueChanged(double);
+		void learn_requested();
 
 };
 
@@ -2,40 +2,63 @@
 #define DISPOSABLE_HH
 
 #include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
 
 #include "disposable_base.h"
 #include "heap.h"
+#include "pool_allocator.h"
 
 #include <iostream>
 
+/**
+	Overload this for types that the engine may still reference through raw
+	pointers. heap::cleanup() will not dispose of such objects while it returns true.
+*/
+template <class T>
+inline bool disposable_in_use(const T &) { return false; }
+
+//! Overload this for types which hold memory on the heap, see disposable_base::memory()
+template <class T>
+inline size_t disposable_memory(const T &) { return sizeof(T); }
+
 template <class T>
 struct disposable : public disposable_base {
+	private:
+		//! Only create() can get hold of one of these
+		struct create_key { };
+
+	public:
 	T t;
 
 	/**
 		The only way to create a disposable<T> is by using this create() method
+
+		The object and the shared_ptr control block are allocated in one go
+		from a pool of blocks of matching size.
 	*/
 	static boost::shared_ptr<
 		disposable<T> 
 	> create(const T& t = T()) 
 	{
-		return boost::shared_ptr<disposable<T> > (
-			heap::get()->add(
-				boost::shared_ptr<disposable<T> > (new disposable<T>(t))
-			)
+		return heap::get()->add(
+			boost::allocate_shared<disposable<T> >(pool_allocator<disposable<T> >(), t, create_key())
 		);
 	}
 
 
 	virtual ~disposable() { /* std::cout << "~disposable()" << std::endl; */ }
 
-	private:
-		/**
-			Force creation on the heap by making the constructor private.
-		*/
-		disposable(const T &t = T()) : t(t) { 
-			// std::cout << "disposable()" << std::endl;
-		}
+	virtual bool in_use() const { return disposable_in_use(t); }
+
+	virtual size_t memory() const { return sizeof(disposable<T>) - sizeof(T) + disposable_memory(t); }
+
+	/**
+		Force creation through create() by requiring a key that only create() can
+		produce. The constructor has to be public for boost::allocate_shared.
+	*/
+	disposable(const T &t, create_key) : t(t) { 
+		// std::cout << "disposable()" << std::endl;
+	}
 };
 
 
@@ -1,10 +1,18 @@
 #ifndef DISPOSABLE_BASE_HH
 #define DISPOSABLE_BASE_HH
 
+#include <cstddef>
+
 #include <boost/shared_ptr.hpp>
 
 struct disposable_base {
 	virtual ~disposable_base() { }
+
+	//! Returns true while something other than a shared_ptr still refers to the object
+	virtual bool in_use() const { return false; }
+
+	//! The bytes the object occupies, including what it holds on the heap
+	virtual size_t memory() const { return 0; }
 };
 
 typedef boost::shared_ptr<disposable_base> disposable_base_ptr;
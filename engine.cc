@@ -12,6 +12,10 @@ extern "C" {
 		((engine*)arg)->shutdown();
 	}
 
+	void freewheel_callback(int starting, void *arg) {
+		((engine*)arg)->freewheel(starting != 0);
+	}
+
 
 #ifndef NO_JACK_SESSION
 	void session_callback(jack_session_event_t *event, void *p) {
@@ -2,7 +2,6 @@
 #define JASS_ENGINE_HH
 
 #include <vector>
-#include <list>
 #include <algorithm>
 #include <iostream>
 
@@ -15,69 +14,46 @@
 #include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/bind.hpp>
-#include <boost/function.hpp>
 
-#include "disposable.h"
-#include "generator.h"
-#include "ringbuffer.h"
+#include "engine_core.h"
+#include "latency_test.h"
 #include "jass.hxx"
 #include "xsd_error_handler.h"
-#include "assign.h"
-#include "voice.h"
-#include "command_queue.h"
 
 #include <QObject>
 
-typedef std::vector<disposable_generator_ptr> generator_vector;
-typedef disposable<generator_vector> disposable_generator_vector;
-typedef boost::shared_ptr<disposable_generator_vector> disposable_generator_vector_ptr;
-
-typedef std::list<disposable_generator_ptr> generator_list;
-typedef disposable<generator_list> disposable_generator_list;
-typedef boost::shared_ptr<disposable_generator_list> disposable_generator_list_ptr;
-
-
 struct engine;
 
 extern "C" {
 	int process_callback(jack_nframes_t, void *p);
 	void shutdown_callback(void *arg);
+	void freewheel_callback(int starting, void *arg);
 #ifndef NO_JACK_SESSION
 	void session_callback(jack_session_event_t *event, void *arg);
 #endif
 }
 
 
-struct gvoice {
-	disposable_generator_ptr g;
-	voice v;
-
-	//! we use a singly linked list to mark active voices
-	gvoice *next;
-};
-typedef disposable<std::vector<gvoice> > disposable_gvoice_vector;
-typedef boost::shared_ptr<disposable_gvoice_vector> disposable_gvoice_vector_ptr;
-
-
-class engine : public QObject, public command_queue {
+//! Connects engine_core to JACK and the GUI
+class engine : public QObject, public engine_core {
 	Q_OBJECT
 
 	public:
-		disposable_generator_list_ptr gens;
-
-		//! a single generator to audit a sample
-		disposable_generator_ptr auditor_gen;
-
 		jack_client_t *jack_client;
 		jack_port_t *out_0;
 		jack_port_t *out_1;
 		jack_port_t *midi_in;
 
-		//! Set this member only using the set_samplerate method..
-		double sample_rate;
+		//! Only registered for the latency self test, see enable_latency_test()
+		jack_port_t *latency_out;
+		jack_port_t *latency_in;
 
-		disposable_gvoice_vector_ptr voices;
-		unsigned int current_voice;
+		//! Set through a command once the latency test ports exist
+		bool latency_ports;
+		latency_test latency_test_;
+
+		//! The midi events of the current period are copied here for engine_core::process()
+		std::vector<jack_midi_event_t> midi_events;
 
 		volatile bool active;
 		
@@ -90,10 +66,10 @@ class engine : public QObject, public command_queue {
 		static engine *instance;
 		engine(const char *uuid = 0) 
 		: 
-			command_queue(1024, 1024),
-			gens(disposable_generator_list::create(generator_list())),
-			voices(disposable_gvoice_vector::create(std::vector<gvoice>(32))),
-			current_voice(0),
+			latency_out(0),
+			latency_in(0),
+			latency_ports(false),
+			midi_events(4096),
 			active(false)
 		{
 			heap *h = heap::get();	
@@ -109,7 +85,10 @@ class engine : public QObject, public command_queue {
 			out_1 = jack_port_register(jack_client, "out_1", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
 			midi_in = jack_port_register(jack_client, "in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
 
-			sample_rate = jack_get_sample_rate(jack_client);
+			set_sample_rate(jack_get_sample_rate(jack_client));
+
+			//! Nothing runs yet, so no command needed
+			governor_.enabled = true;
 
 #ifndef NO_JACK_SESSION
 			jack_set_session_callback(jack_client, ::session_callback, this);
@@ -117,6 +96,7 @@ class engine : public QObject, public command_queue {
 
 			jack_set_process_callback(jack_client, process_callback, (void*)this);
 			jack_on_shutdown(jack_client, shutdown_callback, (void *)this);
+			jack_set_freewheel_callback(jack_client, freewheel_callback, (void *)this);
 
 			if (0 == jack_activate(jack_client))
 				active = true;
@@ -129,15 +109,14 @@ class engine : public QObject, public command_queue {
 			instance = 0;
 		}
 
-		void set_number_of_voices(unsigned int num) {
-			disposable_voice_vector_ptr voices = disposable_voice_vector::create(std::vector<voice>(num));
-		}
-
-		void set_sample_rate(double rate) {
-			if (rate != sample_rate) {
-				sample_rate = rate;
-				//! TODO: Reload all samples..
-			}
+		/**
+			Called by JACK when it starts or stops freewheeling. This is not
+			necessarily the process thread, so only the flag is set here and the
+			process thread switches between live_profile and freewheel_profile at the
+			start of its next period.
+		*/
+		void freewheel(bool starting) {
+			freewheeling = starting;
 		}
 
 #ifndef NO_JACK_SESSION
@@ -146,120 +125,52 @@ class engine : public QObject, public command_queue {
 		}
 #endif
 
-		void play_auditor() {
-			assert(auditor_gen.get());
-			
-			voices->t[current_voice].g = auditor_gen;
-			voices->t[current_voice].v.channel = 17;
-			voices->t[current_voice].v.note = 64;
-			voices->t[current_voice].v.note_on_velocity = 128;
-			voices->t[current_voice].v.note_on_frame = jack_last_frame_time(jack_client);
-			voices->t[current_voice].v.state = voice::ATTACK;
-			current_voice = (++current_voice) % voices->t.size();
-		}
+		/**
+			Register the MIDI out and audio in ports of the latency self test and
+			tell the process thread about them. Call this in the main thread.
+			Returns false if the ports could not be registered.
+		*/
+		bool enable_latency_test() {
+			if (latency_out) return true;
 
-		inline void process_note_on(jack_nframes_t nframes, unsigned int note, unsigned int velocity, unsigned int channel) {
-			// find responsible generator
-			for (generator_list::iterator it = gens->t.begin(); it != gens->t.end(); ++it) {
-				if (
-					(*it)->t.channel == channel &&
-					(*it)->t.min_note <= note &&
-					(*it)->t.max_note >= note &&
-					(*it)->t.min_velocity <= velocity &&
-					(*it)->t.max_velocity >= velocity
-				) {
-					//! setup voice with parameters
-					voices->t[current_voice].g = (*it);
-					voices->t[current_voice].v.channel = channel;
-					voices->t[current_voice].v.note = note;
-					voices->t[current_voice].v.note_on_velocity = velocity;
-					voices->t[current_voice].v.note_on_frame = nframes;
-					voices->t[current_voice].v.state = voice::ATTACK;
-
-					//! TODO: decide on better voice allocation algo
-					current_voice = (++current_voice) % voices->t.size();
-					//std::cout << "current_voice" << current_voice << std::endl;
-				}
-			}
-		}
+			latency_out = jack_port_register(jack_client, "latency_out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
+			latency_in = jack_port_register(jack_client, "latency_in", JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+			if (!latency_out || !latency_in) return false;
 
-		//! switch envelope states of voices responsible for this note to RELEASE
-		inline void process_note_off(jack_nframes_t nframes, unsigned int note, unsigned int channel) {
-			for (unsigned int voice = 0; voice != voices->t.size(); ++voice) {
-				if (
-					voices->t[voice].v.state == voice::ATTACK && 
-					voices->t[voice].v.channel == channel && 
-					voices->t[voice].v.note == note
-				) {
-					voices->t[voice].v.state = voice::RELEASE;
-					voices->t[voice].v.note_off_frame = nframes;
-				}
-			}	
+			write_command(assign(latency_ports, true));
+			return true;
 		}
 
+		void play_auditor() {
+			assert(auditor_gen.get());
+			
+			start_voice(auditor_gen->t, jack_last_frame_time(jack_client), 64, 128, auditor_channel);
+		}
 
 		inline void process(jack_nframes_t nframes) {
-			//! Execute commands passed in through ringbuffer
-			while(commands.can_read()) { /* std::cout << "read()()" << std::endl; */ 
-				commands.read()(); 
-				if (!acknowledgements.can_write()) std::cout << "ack buffer full" << std::endl;
-				else acknowledgements.write(0);
-			}
-
 			float *out_0_buf = (float*)jack_port_get_buffer(out_0, nframes);
 			float *out_1_buf = (float*)jack_port_get_buffer(out_1, nframes);
 			void *midi_in_buf = jack_port_get_buffer(midi_in, nframes);	
 
-			//! zero the buffers first
-			std::fill(out_0_buf, out_0_buf + nframes, 0);
-			std::fill(out_1_buf, out_1_buf + nframes, 0);
-
-			//! Synthesize
-			if (auditor_gen.get()) {
-				//auditor_gen->t.process(out_0_buf, out_1_buf, midi_in_buf, nframes, jack_client);
+			//! Events beyond the preallocated ones are dropped
+			const jack_nframes_t midi_in_event_count = 
+				std::min(jack_midi_get_event_count(midi_in_buf), (jack_nframes_t)midi_events.size());
+			for (jack_nframes_t index = 0; index < midi_in_event_count; ++index) {
+				jack_midi_event_get(&midi_events[index], midi_in_buf, index);
 			}
 
-			const jack_nframes_t last_frame_time = jack_last_frame_time(jack_client);
-
-			jack_nframes_t midi_in_event_index = 0;
-			jack_nframes_t midi_in_event_count = jack_midi_get_event_count(midi_in_buf);
-	
-			jack_midi_event_t midi_event;
-			if (midi_in_event_count > 0)
-				jack_midi_event_get(&midi_event, midi_in_buf, midi_in_event_index);
-
-			for (unsigned int frame = 0; frame < nframes; ++frame) {
-				//! process midi events first to update voice states
-				while (midi_in_event_index < midi_in_event_count && midi_event.time == frame) {
-					if (((*(midi_event.buffer) & 0xf0)) == 0x80
-						|| (((*(midi_event.buffer) & 0xf0) == 0x90 && *(midi_event.buffer+2) == 0))
-					) {
-						process_note_off(
-							last_frame_time+frame, 
-							*(midi_event.buffer+1), 
-							(*(midi_event.buffer) & 0x0f)
-						);
-					}
-		
-					if (((*(midi_event.buffer) & 0xf0)) == 0x90 && *(midi_event.buffer+2) != 0) {
-						process_note_on(
-							last_frame_time + frame, 
-							*(midi_event.buffer+1), 
-							*(midi_event.buffer+2),
-							(*(midi_event.buffer) & 0x0f)
-						);
-					}
-					++midi_in_event_index;
-					jack_midi_event_get(&midi_event, midi_in_buf, midi_in_event_index);
-				}
-
-				//! then process voices
-				//! TODO: introduce linked list in the preallocated voices to make this faster. i.e. only iterate over active voices
-				for (unsigned int index = 0; index < voices->t.size(); ++index) {
-					if (voices->t[index].v.state != voice::OFF) {
-						voices->t[index].g->t.process(out_0_buf, out_1_buf, last_frame_time, frame, jack_get_sample_rate(jack_client), voices->t[index].v);
-					}
-				}
+			engine_core::process(
+				out_0_buf, out_1_buf, 
+				&midi_events[0], midi_in_event_count, 
+				nframes, 
+				jack_last_frame_time(jack_client), 
+				jack_get_sample_rate(jack_client)
+			);
+
+			if (latency_ports) {
+				void *latency_out_buf = jack_port_get_buffer(latency_out, nframes);
+				jack_midi_clear_buffer(latency_out_buf);
+				latency_test_.process(latency_out_buf, (const float*)jack_port_get_buffer(latency_in, nframes), nframes, jack_last_frame_time(jack_client));
 			}
 		}
 
@@ -0,0 +1,726 @@
+#ifndef JASS_ENGINE_CORE_HH
+#define JASS_ENGINE_CORE_HH
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
+#include "disposable.h"
+#include "generator.h"
+#include "ringbuffer.h"
+#include "assign.h"
+#include "voice.h"
+#include "voice_pool.h"
+#include "channel_state.h"
+#include "controller_map.h"
+#include "command_queue.h"
+#include "rt_log.h"
+#include "trace.h"
+#include "cpu_stats.h"
+#include "memory_usage.h"
+#include "render_profile.h"
+#include "load_governor.h"
+#include "prerender.h"
+
+/**
+	The generators are kept in a contiguous vector which is treated as
+	copy-on-write: an edit copies the vector (i.e. just the pointers), changes
+	the copy and swaps it into the engine as a whole.
+*/
+typedef std::vector<disposable_generator_ptr> generator_vector;
+
+//! Just the pointers, the generators are disposables of their own
+inline size_t disposable_memory(const generator_vector &v) {
+	return sizeof(generator_vector) + vector_memory(v);
+}
+typedef disposable<generator_vector> disposable_generator_vector;
+typedef boost::shared_ptr<disposable_generator_vector> disposable_generator_vector_ptr;
+
+
+/**
+	Everything the process thread does, without JACK or Qt: commands, MIDI
+	handling, voice allocation and rendering. engine drives this from the JACK
+	process callback, the benchmark and the tests drive it directly.
+*/
+class engine_core : public command_queue {
+	public:
+		disposable_generator_vector_ptr gens;
+
+		//! a single generator to audit a sample
+		disposable_generator_ptr auditor_gen;
+
+		//! Set this member only using the set_samplerate method..
+		double sample_rate;
+
+		//! Holds polyphony voices plus a reserve in which stolen voices fade out (see voice_reserve())
+		disposable_voice_pool_ptr voices;
+
+		//! The maximum number of voices playing at the same time, not counting fading voices
+		unsigned int polyphony;
+
+		enum voice_stealing_policy { STEAL_OLDEST, STEAL_QUIETEST, STEAL_RELEASING_FIRST };
+		voice_stealing_policy voice_stealing;
+
+		//! The auditor plays on a channel of its own which no MIDI reaches, see engine::play_auditor()
+		enum { midi_channels = 16, auditor_channel = midi_channels };
+
+		//! Held keys and pedals of the 16 MIDI channels and the auditor's channel
+		channel_state channels[midi_channels + 1];
+
+		//! The range of the pitch bend wheel in semitones (up and down)
+		unsigned int pitch_bend_range;
+
+		//! MIDI controllers mapped to generator parameters. Replace it as a whole with set_controller_map()
+		disposable_controller_map_ptr controller_map;
+
+		//! A mapped parameter crosses its whole range in no less than this many frames
+		unsigned int controller_smoothing_frames;
+
+		//! The number of mapped parameters which did not reach their target yet
+		unsigned int controllers_moving;
+
+		//! If not 0, the next unmapped controller moved is reported for the generator with this id and parameter (see learn())
+		unsigned int learn_generator;
+		int learn_parameter;
+
+		//! Settled parameter values and learned controllers. Drained in the GUI thread (see main_window::drain_controller_feedback())
+		controller_feedback controller_feedback_;
+
+		//! The length of the fade out of stolen and choked voices
+		unsigned int fade_frames;
+
+		//! Render the voices grouped by sample (see voice_pool::sort_active())
+		bool sort_voices;
+
+		//! Voices which can not get louder than this (linear gain) anymore are turned off
+		double silence_threshold;
+
+		//! The quality settings for real time and for freewheeling (see render_profile.h). Change them through write_command()
+		render_profile live_profile;
+		render_profile freewheel_profile;
+
+		//! Set while JACK freewheels, see engine::freewheel(). The process thread picks it up at the start of the next period
+		volatile bool freewheeling;
+
+		//! The profile of the current period. Only used in the process thread
+		render_profile profile;
+		bool profile_freewheeling;
+
+		//! Lowers the quality when the process callback gets close to the end of its period. Off unless enabled
+		load_governor governor_;
+
+		//! Renders release tails ahead of time in a thread of its own. Off unless started, see start_prerender()
+		prerenderer prerender_;
+
+		//! Messages from the process thread. Drained in the GUI thread (see main_window::append_engine_log())
+		rt_log log_;
+
+		//! What the process thread did recently. See main_window::dump_trace()
+		trace trace_;
+
+		//! The time spent in process(). The generators count their own, see generator::cpu
+		cpu_stats cpu_stats_;
+
+		engine_core(double sample_rate = 48000) 
+		: 
+			command_queue(1024, 1024),
+			gens(disposable_generator_vector::create(generator_vector())),
+			sample_rate(sample_rate),
+			voices(disposable_voice_pool::create(voice_pool(32 + voice_reserve(32)))),
+			polyphony(32),
+			voice_stealing(STEAL_OLDEST),
+			pitch_bend_range(2),
+			controller_map(disposable_controller_map::create(controller_mapping_vector())),
+			controller_smoothing_frames(480),
+			controllers_moving(0),
+			learn_generator(0),
+			learn_parameter(PARAMETER_GAIN),
+			sort_voices(true),
+			silence_threshold(pow(10.0, -90.0/20.0)),
+			live_profile(render_profile::live()),
+			freewheel_profile(render_profile::freewheel()),
+			freewheeling(false),
+			profile(live_profile),
+			profile_freewheeling(false)
+		{
+			set_sample_rate(sample_rate);
+		}
+
+		void set_number_of_voices(unsigned int num) {
+			disposable_voice_vector_ptr voices = disposable_voice_vector::create(std::vector<voice>(num));
+		}
+
+		//! The number of extra voices needed for fading out stolen voices
+		static unsigned int voice_reserve(unsigned int polyphony) {
+			return std::max(polyphony / 4, 4u);
+		}
+
+		//! Create a voice pool for the given polyphony, including the reserve
+		static disposable_voice_pool_ptr create_voices(unsigned int polyphony) {
+			return disposable_voice_pool::create(voice_pool(polyphony + voice_reserve(polyphony)));
+		}
+
+		//! Swap in a new voice pool (see create_voices()). Run this in the process thread (i.e. through write_command())
+		void set_voices(disposable_voice_pool_ptr new_voices, unsigned int new_polyphony) {
+			for (unsigned int index = 0; index < voices->t.size(); ++index) {
+				if (voices->t.voices[index].tail >= 0) prerender_.release(voices->t.voices[index]);
+			}
+			voices->t.release_all();
+			voices = new_voices;
+			polyphony = new_polyphony;
+		}
+
+		//! Sets the sample rate and everything that is given in frames
+		void set_sample_rate(double rate) {
+			if (rate != sample_rate) {
+				sample_rate = rate;
+				//! TODO: Reload all samples..
+			}
+
+			//! Rate limit the engine log per second
+			log_.window_frames = sample_rate;
+
+			//! 5 ms
+			fade_frames = sample_rate / 200;
+
+			//! 10 ms
+			controller_smoothing_frames = sample_rate / 100;
+
+			//! 1 s
+			governor_.restore_frames = sample_rate;
+
+			//! 100 ms
+			prerender_.min_tail_frames = sample_rate / 10;
+		}
+
+		/**
+			Start the worker which renders release tails ahead of time, with room for
+			slots tails at once (see prerender.h). Call this in the GUI thread, once.
+		*/
+		void start_prerender(unsigned int slots) {
+			prerender_.start(slots);
+			write_command(assign(prerender_.enabled, true));
+		}
+
+		//! Give the rest of v's release to the prerenderer if it is long enough to be worth it
+		inline void hand_off_tail(voice &v, generator &g, jack_nframes_t frame_time, jack_nframes_t rate) {
+			if (!prerender_.enabled || profile_freewheeling || v.tail >= 0 || v.state != voice::RELEASE || v.fade_remaining != 0) return;
+
+			const double remaining = g.hot.release * rate - (double)(frame_time - v.note_off_frame);
+			if (remaining < prerender_.min_tail_frames) return;
+
+			prerender_.hand_off(
+				v, g, frame_time, rate,
+				profile.min_interpolation, profile.max_interpolation,
+				profile.retire_silent, governor_.silence_threshold(silence_threshold),
+				channels[v.channel].pitch_bend
+			);
+		}
+
+		//! Returns true if candidate should rather be stolen than victim
+		inline bool steal_before(const voice &candidate, const voice &victim, jack_nframes_t now) const {
+			switch (governor_.steal_oldest() ? STEAL_OLDEST : voice_stealing) {
+				case STEAL_QUIETEST:
+					return candidate.gain < victim.gain;
+				case STEAL_RELEASING_FIRST:
+					if ((candidate.state == voice::RELEASE) != (victim.state == voice::RELEASE)) 
+						return candidate.state == voice::RELEASE;
+					// fall through
+				case STEAL_OLDEST:
+				default:
+					return (now - candidate.note_on_frame) > (now - victim.note_on_frame);
+			}
+		}
+
+		/**
+			Find a voice for a new note of generator g and start it. Voices which are 
+			choked, retriggered or stolen fade out in the reserve voices. Only if there
+			is no free voice left, a voice is cut off without a fade.
+		*/
+		inline void start_voice(generator &g, jack_nframes_t nframes, unsigned int note, unsigned int velocity, unsigned int channel) {
+			voice_pool &pool = voices->t;
+			std::vector<voice> &vs = pool.voices;
+
+			int free_voice = -1;
+			int victim = -1;
+			int generator_victim = -1;
+			unsigned int playing = 0;
+			unsigned int generator_playing = 0;
+
+			//! The voice that faded the furthest, in case there is no free voice left
+			int last_resort = -1;
+
+			for (unsigned int index = 0; index < vs.size(); ++index) {
+				if (!pool.active(index)) {
+					if (free_voice < 0) free_voice = index;
+					continue;
+				}
+
+				voice &v = vs[index];
+
+				if (v.fade_remaining != 0) {
+					if (last_resort < 0 || v.fade_remaining < vs[last_resort].fade_remaining) last_resort = index;
+					continue;
+				}
+
+				if (pool.generators[index] == &g) {
+					if (
+						g.retrigger && v.note == note && v.channel == channel
+					) {
+						v.fade_out(fade_frames);
+						continue;
+					}
+				}
+
+				if (g.choke_group != 0 && pool.generators[index]->choke_group == g.choke_group) {
+					v.fade_out(fade_frames);
+					continue;
+				}
+
+				++playing;
+				if (victim < 0 || steal_before(v, vs[victim], nframes)) victim = index;
+
+				if (pool.generators[index] == &g) {
+					++generator_playing;
+					if (generator_victim < 0 || steal_before(v, vs[generator_victim], nframes)) generator_victim = index;
+				}
+			}
+
+			//! Enforce the generator's limit first, then the polyphony
+			int stolen = -1;
+			if (!profile.voice_limits) {
+				//! Only steal when the pool is exhausted, see below
+			} else if (g.max_voices != 0 && generator_playing >= g.max_voices) {
+				stolen = generator_victim;
+			} else if (playing >= governor_.polyphony(polyphony)) {
+				stolen = victim;
+			}
+
+			if (stolen >= 0) {
+				log_.write(rt_log::VOICE_STOLEN, nframes, stolen, vs[stolen].note, note);
+				trace_.instant(trace::VOICE_STEAL, stolen, vs[stolen].note);
+				vs[stolen].fade_out(fade_frames);
+			}
+
+			int index = free_voice;
+			if (index < 0) {
+				//! No room to fade, so cut something off
+				index = (stolen >= 0) ? stolen : (last_resort >= 0 ? last_resort : victim);
+				if (index < 0) return;
+			}
+
+			trace_.instant(trace::VOICE_ALLOCATE, index, note);
+
+			//! setup voice with parameters
+			if (vs[index].tail >= 0) prerender_.release(vs[index]);
+			pool.unlink(index);
+			pool.bind(index, &g);
+			voice &v = vs[index];
+			v.channel = channel;
+			v.note = note;
+			v.note_on_velocity = velocity;
+			v.note_on_frame = nframes;
+			v.state = voice::ATTACK;
+			v.fade_remaining = 0;
+			g.start(v, channels[channel].pitch_bend);
+
+			//! Start where the attack starts (-70 dB, like the per frame renderer did), not at 0
+			v.gain = g.gain_at(v, nframes, (jack_nframes_t)sample_rate);
+			pool.update_key(index);
+			pool.link(index);
+		}
+
+		inline void process_note_on(jack_nframes_t nframes, unsigned int note, unsigned int velocity, unsigned int channel) {
+			trace_.instant(trace::NOTE_ON, note, channel);
+
+			channels[channel].held.set(note);
+
+			// find responsible generator
+			for (generator_vector::iterator it = gens->t.begin(); it != gens->t.end(); ++it) {
+				if (
+					(*it)->t.channel == channel &&
+					(*it)->t.min_note <= note &&
+					(*it)->t.max_note >= note &&
+					(*it)->t.min_velocity <= velocity &&
+					(*it)->t.max_velocity >= velocity
+				) {
+					start_voice((*it)->t, nframes, note, velocity, channel);
+				}
+			}
+		}
+
+		//! switch envelope states of voices responsible for this note to RELEASE, unless a pedal holds them
+		inline void process_note_off(jack_nframes_t nframes, unsigned int note, unsigned int channel) {
+			trace_.instant(trace::NOTE_OFF, note, channel);
+
+			channel_state &c = channels[channel];
+			c.held.reset(note);
+
+			if (c.pedal_holds(note)) {
+				c.sustained.set(note);
+				return;
+			}
+
+			voices->t.release_chain(channel, note, nframes);
+		}
+
+		//! Release the sustained keys which neither a pedal nor a finger holds anymore
+		inline void release_sustained(jack_nframes_t nframes, unsigned int channel) {
+			channel_state &c = channels[channel];
+			if (c.sustain_pedal) return;
+
+			note_set keys = c.sustained & ~c.held;
+			if (c.sostenuto_pedal) keys = keys & ~c.sostenuto_keys;
+
+			while (!keys.empty()) {
+				const unsigned int note = keys.pop();
+				c.sustained.reset(note);
+				voices->t.release_chain(channel, note, nframes);
+			}
+		}
+
+		/**
+			Set the pitch bend of a channel (value 0 - 16383, 8192 is the center) and 
+			retune the voices playing on it. The new increments apply from the current
+			segment on.
+		*/
+		inline void process_pitch_bend(unsigned int value, unsigned int channel) {
+			channel_state &c = channels[channel];
+
+			const int bend = ((int)value - 8192) * (int)pitch_bend_range * 100 / 8192;
+			if (bend == c.pitch_bend) return;
+			c.pitch_bend = bend;
+
+			voice_pool &pool = voices->t;
+			for (int index = pool.first_on_channel(channel); index >= 0; index = pool.channel_next[index]) {
+				pool.voices[index].increment = pitch_ratio(pool.voices[index].pitch + bend);
+			}
+		}
+
+		//! Handles sustain (64), sostenuto (66), all sound off (120) and all notes off (123)
+		inline void process_control_change(jack_nframes_t nframes, unsigned int controller, unsigned int value, unsigned int channel) {
+			channel_state &c = channels[channel];
+
+			switch (controller) {
+				case 64:
+					c.sustain_pedal = value >= 64;
+					if (!c.sustain_pedal) release_sustained(nframes, channel);
+					break;
+
+				case 66:
+					if (value >= 64 && !c.sostenuto_pedal) {
+						c.sostenuto_pedal = true;
+						c.sostenuto_keys = c.held;
+					} else if (value < 64 && c.sostenuto_pedal) {
+						c.sostenuto_pedal = false;
+						release_sustained(nframes, channel);
+						c.sostenuto_keys.clear();
+					}
+					break;
+
+				case 120:
+				case 123: {
+					//! Only held and sustained keys can have voices in ATTACK
+					note_set keys = c.held | c.sustained;
+					c.held.clear();
+					c.sustained.clear();
+					while (!keys.empty()) {
+						voices->t.release_chain(channel, keys.pop(), nframes);
+					}
+
+					if (controller == 120) {
+						voice_pool &pool = voices->t;
+						for (unsigned int index = 0; index < pool.size(); ++index) {
+							if (pool.active(index) && pool.voices[index].channel == channel) pool.voices[index].fade_out(fade_frames);
+						}
+					}
+					break;
+				}
+
+				default:
+					process_mapped_controller(controller, value, channel);
+					break;
+			}
+		}
+
+
+		//! Swap in a new controller map. Run this in the process thread (i.e. through write_command())
+		void set_controller_map(disposable_controller_map_ptr map) {
+			controller_map = map;
+			controllers_moving = 0;
+			for (unsigned int index = 0; index < map->t.size(); ++index) {
+				if (!map->t[index].settled) ++controllers_moving;
+			}
+		}
+
+		//! Report the next controller moved for parameter of g. Call this in the GUI thread
+		void learn(disposable_generator_ptr g, int parameter) {
+			write_command(assign(learn_parameter, parameter));
+			write_command(assign(learn_generator, g->t.id));
+		}
+
+		inline void process_mapped_controller(unsigned int controller, unsigned int value, unsigned int channel) {
+			if (learn_generator) {
+				controller_feedback_.write(controller_feedback::CONTROLLER_LEARNED, learn_generator, learn_parameter, channel, controller, 0);
+				learn_generator = 0;
+				return;
+			}
+
+			controller_mapping_vector &m = controller_map->t;
+			for (unsigned int index = 0; index < m.size(); ++index) {
+				if (m[index].channel != channel || m[index].controller != controller) continue;
+
+				m[index].target = m[index].value_of(value);
+				if (m[index].settled) {
+					m[index].settled = false;
+					++controllers_moving;
+				}
+			}
+		}
+
+		/**
+			Move the mapped parameters towards their targets, at most by the part of their
+			range that frames frames allow. The segments are at most one envelope block long
+			while anything moves, so this happens at block boundaries.
+		*/
+		inline void advance_controllers(jack_nframes_t frames) {
+			if (controllers_moving == 0) return;
+
+			controller_mapping_vector &m = controller_map->t;
+			for (unsigned int index = 0; index < m.size(); ++index) {
+				controller_mapping &c = m[index];
+				if (c.settled) continue;
+
+				const double step = fabs(c.max - c.min) * frames / controller_smoothing_frames;
+				const double difference = c.target - c.current;
+
+				if (fabs(difference) <= step) {
+					c.current = c.target;
+					c.settled = true;
+					--controllers_moving;
+					controller_feedback_.write(controller_feedback::PARAMETER_CHANGED, c.gen->t.id, c.parameter, c.channel, c.controller, c.current);
+				} else {
+					c.current += (difference > 0) ? step : -step;
+				}
+
+				controller_parameter_of(c.gen->t, c.parameter) = c.current;
+				c.gen->t.update();
+			}
+		}
+
+		/**
+			Fade out the oldest voices until at most limit voices play, not counting
+			the ones fading already. This reuses voice_pool::order, which is free
+			again once the period's voices are rendered
+		*/
+		inline void shed_voices(unsigned int limit, jack_nframes_t now) {
+			voice_pool &pool = voices->t;
+
+			unsigned int playing = 0;
+			for (unsigned int index = 0; index < pool.size(); ++index) {
+				if (pool.active(index) && pool.voices[index].fade_remaining == 0) pool.order[playing++] = index;
+			}
+			if (playing <= limit) return;
+
+			std::nth_element(pool.order.begin(), pool.order.begin() + limit, pool.order.begin() + playing, voice_pool::younger(pool, now));
+			for (unsigned int order_index = limit; order_index < playing; ++order_index) {
+				pool.voices[pool.order[order_index]].fade_out(fade_frames);
+			}
+		}
+
+		//! Let the governor judge the period that began at begin and log when it changes the level
+		inline void govern(uint64_t begin, jack_nframes_t nframes, jack_nframes_t frame_time, jack_nframes_t rate) {
+			const unsigned int old_level = governor_.level;
+			const bool changed = profile_freewheeling ? governor_.reset() : governor_.update(begin, nframes, rate);
+			if (!changed) return;
+
+			log_.write(rt_log::LOAD_LEVEL_CHANGED, frame_time, old_level, governor_.level, governor_.load_percent);
+			if (governor_.level > old_level) shed_voices(governor_.polyphony(polyphony), frame_time + nframes);
+		}
+
+		inline bool voices_active() const {
+			return voices->t.any_active();
+		}
+
+		/**
+			Render nframes frames into out_0_buf and out_1_buf (which are overwritten).
+			midi_events have to be sorted by time. last_frame_time is the time of the
+			first frame. This is the process thread.
+		*/
+		inline void process(
+			float *out_0_buf, float *out_1_buf,
+			const jack_midi_event_t *midi_events, const jack_nframes_t midi_in_event_count,
+			const jack_nframes_t nframes,
+			const jack_nframes_t last_frame_time,
+			const jack_nframes_t rate
+		) {
+			const uint64_t callback_begin = trace_.begin();
+			const uint64_t cpu_begin = cpu_counter::begin();
+			const uint64_t governor_begin = load_governor::begin();
+
+			//! Execute commands passed in through ringbuffer
+			bool acknowledged = false;
+			unsigned int command_index = 0;
+			while(commands.can_read()) { /* std::cout << "read()()" << std::endl; */ 
+				const uint64_t command_begin = trace_.begin();
+				commands.read()(); 
+				trace_.span(trace::COMMAND, command_begin, command_index++);
+				if (!acknowledgements.can_write()) log_.write(rt_log::ACK_BUFFER_FULL, last_frame_time);
+				else acknowledgements.write(0);
+				acknowledged = true;
+			}
+			//! One non-blocking write wakes up the GUI no matter how many commands were executed
+			if (acknowledged) ack_event.signal();
+
+			const bool freewheel = freewheeling;
+			if (freewheel != profile_freewheeling) {
+				profile_freewheeling = freewheel;
+				log_.write(rt_log::RENDER_PROFILE_CHANGED, last_frame_time, freewheel ? 1 : 0);
+			}
+			profile = freewheel ? freewheel_profile : live_profile;
+			profile.max_interpolation = governor_.max_interpolation(profile.max_interpolation);
+
+			jack_nframes_t midi_in_event_index = 0;
+
+			//! Without playing voices and midi events the period is silent. JACK does not promise
+			//! that a port buffer keeps its contents between periods, so zero it every time
+			if (midi_in_event_count == 0 && controllers_moving == 0 && !voices_active()) {
+				std::fill(out_0_buf, out_0_buf + nframes, 0);
+				std::fill(out_1_buf, out_1_buf + nframes, 0);
+
+				govern(governor_begin, nframes, last_frame_time, rate);
+				prerender_.flush();
+				log_.flush(last_frame_time + nframes);
+				controller_feedback_.flush();
+				trace_.span(trace::CALLBACK, callback_begin, nframes, last_frame_time);
+				cpu_stats_.process.add(cpu_begin, nframes);
+				return;
+			}
+
+			//! zero the buffers first
+			std::fill(out_0_buf, out_0_buf + nframes, 0);
+			std::fill(out_1_buf, out_1_buf + nframes, 0);
+
+			jack_midi_event_t midi_event;
+			if (midi_in_event_count > 0)
+				midi_event = midi_events[midi_in_event_index];
+
+			//! Render the voices in segments between midi events, so each voice is processed in one go per segment
+			jack_nframes_t frame = 0;
+			while (frame < nframes) {
+				//! process midi events first to update voice states
+				while (midi_in_event_index < midi_in_event_count && midi_event.time <= frame) {
+					if (((*(midi_event.buffer) & 0xf0)) == 0x80
+						|| (((*(midi_event.buffer) & 0xf0) == 0x90 && *(midi_event.buffer+2) == 0))
+					) {
+						process_note_off(
+							last_frame_time+frame, 
+							*(midi_event.buffer+1), 
+							(*(midi_event.buffer) & 0x0f)
+						);
+					}
+		
+					if (((*(midi_event.buffer) & 0xf0)) == 0x90 && *(midi_event.buffer+2) != 0) {
+						process_note_on(
+							last_frame_time + frame, 
+							*(midi_event.buffer+1), 
+							*(midi_event.buffer+2),
+							(*(midi_event.buffer) & 0x0f)
+						);
+					}
+					if (((*(midi_event.buffer) & 0xf0)) == 0xb0) {
+						process_control_change(
+							last_frame_time + frame, 
+							*(midi_event.buffer+1), 
+							*(midi_event.buffer+2),
+							(*(midi_event.buffer) & 0x0f)
+						);
+					}
+
+					if (((*(midi_event.buffer) & 0xf0)) == 0xe0) {
+						process_pitch_bend(
+							*(midi_event.buffer+1) | (*(midi_event.buffer+2) << 7),
+							(*(midi_event.buffer) & 0x0f)
+						);
+					}
+
+					++midi_in_event_index;
+					if (midi_in_event_index < midi_in_event_count)
+						midi_event = midi_events[midi_in_event_index];
+				}
+
+				jack_nframes_t segment_end = 
+					(midi_in_event_index < midi_in_event_count) ? std::min(midi_event.time, nframes) : nframes;
+
+				//! Mapped parameters move in envelope block steps
+				if (controllers_moving != 0) {
+					segment_end = std::min(segment_end, frame + (jack_nframes_t)generator::envelope_block_frames);
+					advance_controllers(segment_end - frame);
+				}
+
+				//! then process voices
+				voice_pool &pool = voices->t;
+				const unsigned int active_voices = pool.sort_active(sort_voices);
+				for (unsigned int order_index = 0; order_index < active_voices; ++order_index) {
+					const unsigned int index = pool.order[order_index];
+					voice &v = pool.voices[index];
+					generator *g = pool.generators[index];
+
+					//! Get the start of what the next voice reads on its way while this one renders
+					if (order_index + 1 < active_voices) {
+						const unsigned int next = pool.order[order_index + 1];
+						const render_region &r = pool.generators[next]->hot.region;
+						const unsigned int position = (unsigned int)pool.voices[next].position;
+						__builtin_prefetch(r.data_0 + position);
+						if (r.data_1) __builtin_prefetch(r.data_1 + position);
+					}
+
+					const uint64_t render_begin = trace_.begin();
+					const uint64_t cpu_render_begin = cpu_counter::begin();
+
+					//! A prerendered tail is mixed in. Whatever it leaves over the voice renders itself
+					unsigned int mixed = 0;
+					if (v.tail >= 0) {
+						const bool stale = prerender_.stale(v, g->hot, channels[v.channel].pitch_bend, profile.min_interpolation, profile.max_interpolation);
+						mixed = prerender_.mix(v, out_0_buf + frame, out_1_buf + frame, segment_end - frame, last_frame_time + frame, stale, log_);
+						if (v.tail < 0) v.increment = pitch_ratio(v.pitch + channels[v.channel].pitch_bend);
+					}
+					if (v.tail < 0) g->follow_tune(v, channels[v.channel].pitch_bend);
+					if (v.state != voice::OFF && mixed < segment_end - frame) {
+						g->render(v, out_0_buf + frame + mixed, out_1_buf + frame + mixed, segment_end - frame - mixed, last_frame_time + frame + mixed, rate, profile.min_interpolation, profile.max_interpolation);
+					}
+					g->cpu.add(cpu_render_begin, segment_end - frame);
+					trace_.span(trace::VOICE_RENDER, render_begin, index, segment_end - frame);
+
+					if (profile.retire_silent && v.tail < 0) g->retire_if_silent(v, governor_.silence_threshold(silence_threshold));
+					if (v.state == voice::OFF) {
+						if (v.tail >= 0) prerender_.release(v);
+						pool.unlink(index);
+						pool.update_key(index);
+						pool.release(index);
+					} else {
+						hand_off_tail(v, *g, last_frame_time + segment_end, rate);
+					}
+				}
+
+				frame = segment_end;
+			}
+
+			govern(governor_begin, nframes, last_frame_time, rate);
+			prerender_.flush();
+			log_.flush(last_frame_time + nframes);
+			controller_feedback_.flush();
+			trace_.span(trace::CALLBACK, callback_begin, nframes, last_frame_time);
+			cpu_stats_.process.add(cpu_begin, nframes);
+		}
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef JASS_EVENT_FD_HH
+#define JASS_EVENT_FD_HH
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include <stdexcept>
+
+/**
+	A thin wrapper around a non-blocking eventfd. signal() is a single
+	non-blocking write(), so it can be called from the process thread
+	and from signal handlers. The reading side hooks fd into its event
+	loop (see notified_functor) and calls drain() when it becomes readable.
+*/
+struct event_fd {
+	int fd;
+
+	event_fd() :
+		fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+	{
+		if (fd == -1) throw std::runtime_error("Couldn't create eventfd");
+	}
+
+	~event_fd() {
+		close(fd);
+	}
+
+	void signal() {
+		const uint64_t one = 1;
+		//! If the counter is saturated the reader is already due to wake up, so the result can be ignored
+		if (write(fd, &one, sizeof(one)) != sizeof(one)) return;
+	}
+
+	//! Returns the number of signals since the last drain() and resets the counter
+	uint64_t drain() {
+		uint64_t count = 0;
+		if (read(fd, &count, sizeof(count)) != sizeof(count)) return 0;
+		return count;
+	}
+
+	private:
+		event_fd(const event_fd&);
+		event_fd &operator=(const event_fd&);
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef JASS_FILTER_HH
+#define JASS_FILTER_HH
+
+#include <cmath>
+#include <algorithm>
+
+enum filter_type { FILTER_OFF, FILTER_LOWPASS, FILTER_HIGHPASS, FILTER_BANDPASS, NUMBER_OF_FILTER_TYPES };
+
+//! As used in the setup files
+static const char * const filter_type_names[NUMBER_OF_FILTER_TYPES] = { "off", "lowpass", "highpass", "bandpass" };
+
+/**
+	The coefficients of a state variable filter (the trapezoidal integrator
+	form, which stays stable under modulation). Compute these once per block,
+	not per frame.
+*/
+struct svf_coefficients {
+	float k;
+	float a1;
+	float a2;
+	float a3;
+
+	//! cutoff in Hz, q > 0
+	void set(double cutoff, double q, double sample_rate) {
+		cutoff = std::min(std::max(cutoff, 10.0), 0.49 * sample_rate);
+
+		const double g = tan(M_PI * cutoff / sample_rate);
+		k = 1.0 / q;
+		a1 = 1.0 / (1.0 + g * (g + k));
+		a2 = g * a1;
+		a3 = g * a2;
+	}
+};
+
+//! The state of a stereo state variable filter
+struct svf {
+	float ic1[2];
+	float ic2[2];
+
+	svf() {
+		reset();
+	}
+
+	void reset() {
+		ic1[0] = ic1[1] = ic2[0] = ic2[1] = 0;
+	}
+
+	//! Filter frames frames of in and add them to out
+	template <int Type>
+	inline void process_channel(unsigned int channel, const svf_coefficients &c, const float *in, float *out, unsigned int frames) {
+		float s1 = ic1[channel];
+		float s2 = ic2[channel];
+
+		for (unsigned int frame = 0; frame < frames; ++frame) {
+			const float v0 = in[frame];
+			const float v3 = v0 - s2;
+			const float v1 = c.a1 * s1 + c.a2 * v3;
+			const float v2 = s2 + c.a2 * s1 + c.a3 * v3;
+			s1 = 2 * v1 - s1;
+			s2 = 2 * v2 - s2;
+
+			if (Type == FILTER_LOWPASS) out[frame] += v2;
+			if (Type == FILTER_BANDPASS) out[frame] += v1;
+			if (Type == FILTER_HIGHPASS) out[frame] += v0 - c.k * v1 - v2;
+		}
+
+		ic1[channel] = s1;
+		ic2[channel] = s2;
+	}
+
+	//! Filter both channels and add them to out_0 and out_1
+	inline void process(int type, const svf_coefficients &c, const float *in_0, const float *in_1, float *out_0, float *out_1, unsigned int frames) {
+		switch (type) {
+			case FILTER_LOWPASS:
+				process_channel<FILTER_LOWPASS>(0, c, in_0, out_0, frames);
+				process_channel<FILTER_LOWPASS>(1, c, in_1, out_1, frames);
+				break;
+			case FILTER_HIGHPASS:
+				process_channel<FILTER_HIGHPASS>(0, c, in_0, out_0, frames);
+				process_channel<FILTER_HIGHPASS>(1, c, in_1, out_1, frames);
+				break;
+			case FILTER_BANDPASS:
+				process_channel<FILTER_BANDPASS>(0, c, in_0, out_0, frames);
+				process_channel<FILTER_BANDPASS>(1, c, in_1, out_1, frames);
+				break;
+			default:
+				break;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef JASS_FILTER_WIDGET_HH
+#define JASS_FILTER_WIDGET_HH
+
+#include <QWidget>
+#include <QComboBox>
+#include <QGridLayout>
+#include <QSignalMapper>
+
+#include "generator.h"
+#include "dial_widget.h"
+#include "engine.h"
+#include "controller_map.h"
+
+struct filter_widget : public QWidget {
+	Q_OBJECT
+
+	disposable_generator_ptr gen;
+
+	QComboBox *type;
+	dial_widget *cutoff;
+	dial_widget *q;
+	dial_widget *velocity_amount;
+	dial_widget *envelope_amount;
+
+	QSignalMapper *learn_mapper;
+
+	public slots:
+		void learn(int parameter) {
+			engine::get()->learn(gen, parameter);
+		}
+
+		void type_changed(int index) {
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.filter_type, index));
+		}
+
+		void changed(double) {
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.filter_cutoff, pow(2.0, cutoff->value())));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.filter_q, q->value()));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.filter_velocity_amount, velocity_amount->value()));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.filter_envelope_amount, envelope_amount->value()));
+		}
+
+	public:
+		//! Show a value the engine settled on for parameter (see controller_feedback)
+		void show_parameter(int parameter, double value) {
+			switch (parameter) {
+				case PARAMETER_FILTER_CUTOFF: cutoff->show_value(log(value)/log(2.0)); break;
+				case PARAMETER_FILTER_Q: q->show_value(value); break;
+			}
+		}
+
+		filter_widget(disposable_generator_ptr gen, QWidget *parent = 0) :
+			QWidget(parent),
+			gen(gen)
+		{
+			type = new QComboBox();
+			type->addItem("Off");
+			type->addItem("Low pass");
+			type->addItem("High pass");
+			type->addItem("Band pass");
+			type->setCurrentIndex(gen->t.filter_type);
+			type->setToolTip("Filter type");
+			connect(type, SIGNAL(currentIndexChanged(int)), this, SLOT(type_changed(int)));
+
+			//! The cutoff dial works in octaves, 2^4 to 2^14.3 Hz
+			cutoff = new dial_widget();
+			cutoff->setToolTip("Cutoff");
+			cutoff->set_min_value(4);
+			cutoff->set_max_value(14.3);
+			cutoff->set_value(log(gen->t.filter_cutoff)/log(2.0));
+			connect(cutoff, SIGNAL(valueChanged(double)), this, SLOT(changed(double)));
+
+			q = new dial_widget();
+			q->setToolTip("Resonance (Q)");
+			q->set_min_value(0.5);
+			q->set_max_value(20);
+			q->set_value(gen->t.filter_q);
+			connect(q, SIGNAL(valueChanged(double)), this, SLOT(changed(double)));
+
+			velocity_amount = new dial_widget();
+			velocity_amount->setToolTip("Velocity to cutoff (octaves)");
+			velocity_amount->set_min_value(-8);
+			velocity_amount->set_max_value(8);
+			velocity_amount->set_value(gen->t.filter_velocity_amount);
+			connect(velocity_amount, SIGNAL(valueChanged(double)), this, SLOT(changed(double)));
+
+			envelope_amount = new dial_widget();
+			envelope_amount->setToolTip("Envelope to cutoff (octaves)");
+			envelope_amount->set_min_value(-8);
+			envelope_amount->set_max_value(8);
+			envelope_amount->set_value(gen->t.filter_envelope_amount);
+			connect(envelope_amount, SIGNAL(valueChanged(double)), this, SLOT(changed(double)));
+
+			learn_mapper = new QSignalMapper(this);
+			learn_mapper->setMapping(cutoff, PARAMETER_FILTER_CUTOFF);
+			learn_mapper->setMapping(q, PARAMETER_FILTER_Q);
+			connect(cutoff, SIGNAL(learn_requested()), learn_mapper, SLOT(map()));
+			connect(q, SIGNAL(learn_requested()), learn_mapper, SLOT(map()));
+			connect(learn_mapper, SIGNAL(mapped(int)), this, SLOT(learn(int)));
+
+			QGridLayout *layout = new QGridLayout();
+			layout->addWidget(type, 0, 0);
+			layout->addWidget(cutoff, 0, 1);
+			layout->addWidget(q, 0, 2);
+			layout->addWidget(velocity_amount, 0, 3);
+			layout->addWidget(envelope_amount, 0, 4);
+			setLayout(layout);
+		}
+};
+
+#endif
@@ -13,14 +13,27 @@
 
 #include "disposable.h"
 #include "sample.h"
+#include "mipmap.h"
 #include "voice.h"
 #include "adsr.h"
+#include "render_descriptor.h"
+#include "cpu_stats.h"
+#include "memory_usage.h"
 
 struct generator {
+	//! Rebuilt by update() from the parameters below. The process thread only reads this when rendering
+	render_descriptor hot;
+
+	//! Where voices start, in frames. Rebuilt by update() too, but only read at note on, so it is not part of hot
+	double start_frame;
+
 	std::string name;
 
 	disposable_sample_ptr sample_;
 
+	//! Octave down copies of the sample for voices transposed up, if any. See mipmap.h
+	disposable_mipmaps_ptr mipmaps_;
+
 	//! sample start and sample end are fractions of the total length of the sample 
 	double sample_start;
 	double sample_end;
@@ -48,12 +61,45 @@ struct generator {
 	double decay_g;
 	double sustain_g;
 	double release_g;
+
+	//! Fine tuning in cents
+	double tune;
+
+	//! A resonant filter per voice (see filter.h). The cutoff is in Hz, the modulation amounts in octaves
+	int filter_type;
+	double filter_cutoff;
+	double filter_q;
+	double filter_velocity_amount;
+	double filter_envelope_amount;
 	
 	unsigned int current_voice;
 
-	//! precalculated stretch table for different note differences
-	//! stretch[128] == 1.0
-	double stretch_factors[256];
+	//! The maximum number of voices playing this generator at the same time. 0 means no limit
+	unsigned int max_voices;
+
+	//! Generators in the same choke group (> 0) cut each other off, e.g. open and closed hi-hat
+	unsigned int choke_group;
+
+	//! If true a note on fades out the voices of this generator still playing the same note
+	bool retrigger;
+
+	//! How the sample is read at fractional positions, see render_kernel.h. The engine may override this, see render_profile.h
+	int interpolation;
+
+	//! Render with the reference kernels and the envelope evaluated every frame. Only used for validation, see reference_render.cc
+	bool reference_render;
+
+	//! The number of voices currently playing this generator. This is only
+	//! ever written in the process thread (see voice_pool::bind()) and keeps
+	//! heap::cleanup() from disposing of the generator while it is playing
+	volatile unsigned int bound_voices;
+
+	//! The time the process thread spent rendering this generator's voices, see cpu_stats.h
+	cpu_counter cpu;
+
+	//! Identifies the generator in records the GUI thread reads later (see controller_feedback).
+	//! Unlike the generator's address it is never reused
+	unsigned int id;
 
 	virtual ~generator()
 	{ 
@@ -82,6 +128,7 @@ struct generator {
 		double sustain_g = 0.0,
 		double release_g = 0.01
 	) :
+		start_frame(0),
 		name(name),
 		sample_(s),
 		sample_start(sample_start),
@@ -102,84 +149,301 @@ struct generator {
 		decay_g(decay_g),
 		sustain_g(sustain_g),
 		release_g(release_g),
-		current_voice(0)
+		tune(0),
+		filter_type(FILTER_OFF),
+		filter_cutoff(20000),
+		filter_q(M_SQRT1_2),
+		filter_velocity_amount(0),
+		filter_envelope_amount(0),
+		current_voice(0),
+		max_voices(0),
+		choke_group(0),
+		retrigger(false),
+		interpolation(LINEAR_INTERPOLATION),
+		reference_render(false),
+		bound_voices(0),
+		id(__sync_add_and_fetch(&last_id(), 1))
 	{ 
-		//! initialize stretch factors lookup table
-		for (int i = 0; i < 256; ++i)
-			stretch_factors[i] = (i - 128 != 0) ? pow(pow(2.0, 1.0/12.0), i - 128) : 1.0;
+		update();
 	}
 
-	//! Process a single frame
-	//! Updates voice info
-	inline void process(
-		float *out_0, float *out_1, 
-		const jack_nframes_t last_frame_time, 
-		const jack_nframes_t frame, 
-		const jack_nframes_t sample_rate, 
-		voice &v
-	) {
-		if (muted || v.state == voice::OFF) return;
+	static unsigned int &last_id() {
+		static unsigned int id = 0;
+		return id;
+	}
 
+	//! The envelope is evaluated every envelope_block_frames frames (every frame with reference_render), the gain is ramped linearly in between
+	enum { envelope_block_frames = 32 };
 
-		const double stretch = stretch_factors[(v.note - note) + 128];
+	//! Whether the looping kernels are used. Loops which end after sample_end never wrap
+	bool loops() const {
+		return looping && loop_end > loop_start && loop_end <= sample_end;
+	}
 
-		const unsigned int sample_length = sample_->t.data_0.size();
-		const unsigned int frames_since_note_on = (last_frame_time + frame - v.note_on_frame);
+	/**
+		Rebuild the render descriptor. Call this whenever a parameter changed.
+		Once the generator is in use this runs in the process thread: both
+		assign_parameter() commands and mapped controllers (see
+		engine_core::advance_controllers()) call it there, between renders. So it
+		must stay bounded. It does not allocate or lock, the kernel selection is
+		a table lookup, and it costs one pow() for the gain.
+	*/
+	void update() {
+		const double frames = sample_->t.frames;
+
+		hot.region.data_0 = sample_->t.begin_0();
+		hot.region.data_1 = sample_->t.begin_1();
+		hot.region.end_frame = sample_end * frames;
+		hot.region.loop_start_frame = loop_start * frames;
+		hot.region.loop_end_frame = loop_end * frames;
+		hot.mipmap_levels = mipmaps_ ? std::min<unsigned int>(mipmaps_->t.levels.size(), render_descriptor::max_mipmap_levels) : 0;
+		hot.mipmaps = hot.mipmap_levels > 0 ? &mipmaps_->t.levels[0] : 0;
+
+		hot.looping = loops();
+		hot.kernels = select_render_functions(hot.looping, sample_->t.channels, reference_render);
+		hot.interpolation = std::min(std::max(interpolation, 0), NUMBER_OF_INTERPOLATIONS - 1);
+		hot.envelope_block = reference_render ? 1 : (unsigned int)envelope_block_frames;
+
+		start_frame = sample_start * frames;
+		hot.gain = muted ? 0 : pow(10.0, gain/20.0);
+		hot.min_velocity = min_velocity;
+		hot.velocity_scale = max_velocity > min_velocity ? velocity_factor / (double)(max_velocity - min_velocity) : 0;
+
+		hot.attack = attack_g;
+		hot.decay = decay_g;
+		hot.sustain = sustain_g;
+		hot.release = release_g;
+
+		hot.tune = (int)floor(tune + 0.5);
+
+		hot.filter_type = filter_type;
+		hot.filter_cutoff = filter_cutoff;
+		hot.filter_q = std::max(filter_q, 0.1);
+		hot.filter_velocity_amount = filter_velocity_amount;
+		hot.filter_envelope_amount = filter_envelope_amount;
+
+		++hot.revision;
+	}
 
-		double current_frame = sample_length * sample_start + (stretch * frames_since_note_on);
+	//! Initialize voice v to start at the beginning of the sample, bent by pitch_bend cents
+	inline void start(voice &v, int pitch_bend) {
+		v.position = start_frame;
+		v.pitch = ((int)v.note - (int)note) * 100 + hot.tune;
+		v.tune = hot.tune;
+		v.increment = pitch_ratio(v.pitch + pitch_bend);
+		v.envelope = 0;
+		v.setup_filters();
+	}
 
-		if (looping) {
-			if (current_frame >= loop_end * sample_length) 
-				current_frame = 
-					(unsigned int)(loop_start * sample_length) + 
-						fmod(
-							(current_frame - (unsigned int)(loop_start * sample_length)), 
-							(unsigned int)(sample_length * (loop_end - loop_start))
-						);
-		}
-					
-		if (current_frame < 0 || current_frame >= sample_length * sample_end) {
-			v.state = voice::OFF;
-			return;
-		} 
+	//! Retune v if the fine tuning changed since it started (e.g. by a mapped controller), bent by pitch_bend cents
+	inline void follow_tune(voice &v, int pitch_bend) const {
+		if (v.tune == hot.tune) return;
+		v.pitch += hot.tune - v.tune;
+		v.tune = hot.tune;
+		v.increment = pitch_ratio(v.pitch + pitch_bend);
+	}
+
+	/**
+		The gain of voice v (envelope, velocity and the generator gain) at
+		frame_time. Also updates v.envelope_rising and v.envelope.
+	*/
+	inline double gain_at(voice &v, const jack_nframes_t frame_time, const jack_nframes_t sample_rate) const {
+		return gain_at(hot, v, frame_time, sample_rate);
+	}
 
-		const double time_since_note_on = (double)(frames_since_note_on)/(double)sample_rate;
+	//! The same for a generator with the render descriptor hot
+	static inline double gain_at(const render_descriptor &hot, voice &v, const jack_nframes_t frame_time, const jack_nframes_t sample_rate) {
+		v.envelope = 0;
+		if (hot.gain == 0) return 0;
+
+		const double time_since_note_on = (double)(frame_time - v.note_on_frame)/(double)sample_rate;
 		double gain_envelope = 0.0;
 
 		if (v.state == voice::ATTACK) {
-			gain_envelope = adsr_attack(attack_g, decay_g, sustain_g, release_g, time_since_note_on);
+			gain_envelope = adsr_attack(hot.attack, hot.decay, hot.sustain, hot.release, time_since_note_on);
+			v.envelope_rising = time_since_note_on < hot.attack;
 		}
 
 		if (v.state == voice::RELEASE) {
 			const double release_time = (double)(v.note_off_frame - v.note_on_frame)/(double)sample_rate;
 
-			gain_envelope = adsr(attack_g, decay_g, sustain_g, release_g, time_since_note_on, release_time);
-			if (release_time - v.note_on_frame/(double)sample_rate >= release_g) 
-			v.state = voice::OFF;
+			if (time_since_note_on - release_time >= hot.release) return 0;
+
+			gain_envelope = adsr(hot.attack, hot.decay, hot.sustain, hot.release, time_since_note_on, release_time);
+			v.envelope_rising = false;
 		}
 
-		const double vel_gain = 
-			velocity_factor * (((double)v.note_on_velocity-min_velocity)
-				/(double)(max_velocity-min_velocity));
+		const double vel_gain = ((double)v.note_on_velocity - hot.min_velocity) * hot.velocity_scale;
 
-		const double g =  pow(10.0, gain_envelope/20.0) * vel_gain * pow(10.0, gain/20.0);
+		v.envelope = fast_db_to_gain(gain_envelope);
+		return v.envelope * vel_gain * hot.gain;
+	}
 
-		float *data_0 = &(sample_->t.data_0[0]);
-		float *data_1 = &(sample_->t.data_1[0]);
+	//! The modulated filter cutoff of voice v in Hz. Uses the envelope level of the last gain_at()
+	static inline double filter_cutoff_of(const render_descriptor &hot, const voice &v) {
+		const double velocity = (double)v.note_on_velocity / 127.0;
+		return hot.filter_cutoff * fast_exp2(hot.filter_velocity_amount * velocity + hot.filter_envelope_amount * v.envelope);
+	}
+
+	/**
+		Render frames frames of voice v into out_0 and out_1, frame_time being the time
+		of the first frame. The sample is read with the generator's interpolation,
+		raised to min_interpolation or lowered to max_interpolation if needed (see
+		render_profile.h). Turns the voice OFF when it is done.
+	*/
+	inline void render(
+		voice &v,
+		float *out_0, float *out_1, 
+		unsigned int frames,
+		jack_nframes_t frame_time,
+		const jack_nframes_t sample_rate,
+		const int min_interpolation = LINEAR_INTERPOLATION,
+		const int max_interpolation = NUMBER_OF_INTERPOLATIONS - 1
+	) {
+		render(hot, v, out_0, out_1, frames, frame_time, sample_rate, min_interpolation, max_interpolation);
+	}
+
+	/**
+		The same for a generator with the render descriptor hot. This only reads
+		hot and the sample data it points to, so it can render a copy of the
+		descriptor outside the process thread (see prerender.h).
+	*/
+	static inline void render(
+		const render_descriptor &hot,
+		voice &v,
+		float *out_0, float *out_1, 
+		unsigned int frames,
+		jack_nframes_t frame_time,
+		const jack_nframes_t sample_rate,
+		const int min_interpolation = LINEAR_INTERPOLATION,
+		const int max_interpolation = NUMBER_OF_INTERPOLATIONS - 1
+	) {
+		const render_function_pair &kernels = hot.kernels[std::min(std::max(hot.interpolation, min_interpolation), max_interpolation)];
+
+		render_region mipmap;
+
+		while (frames > 0 && v.state != voice::OFF) {
+			const unsigned int block = std::min(frames, hot.envelope_block);
+
+			bool done = v.state == voice::RELEASE && 
+				(double)(frame_time + block - v.note_off_frame)/(double)sample_rate >= hot.release;
+
+			double gain_end = gain_at(hot, v, frame_time + block, sample_rate);
+
+			if (v.fade_remaining != 0) {
+				const unsigned int faded = std::min(block, v.fade_remaining);
+				v.fade_remaining -= faded;
+				gain_end *= (double)v.fade_remaining / (double)v.fade_frames;
+				if (v.fade_remaining == 0) done = true;
+			}
+
+			const float gain_step = (gain_end - v.gain) / block;
+
+			//! A voice transposed up by k octaves reads the mipmap k octaves down, in that level's frames
+			const unsigned int level = std::min(mipmap_level_of(v.increment), hot.mipmap_levels);
+			const render_region &region = (level == 0) ? hot.region : mipmap_region(hot, level, mipmap);
+			const double scale = (double)(1u << level);
+			v.position /= scale;
+			v.increment /= scale;
+
+			if (hot.filter_type == FILTER_OFF) {
+				kernels[gain_step != 0 ? 1 : 0](region, v, out_0, out_1, block, v.gain, gain_step);
+			} else {
+				//! Render into a scratch block which is then filtered into the output
+				float block_0[envelope_block_frames];
+				float block_1[envelope_block_frames];
+				std::fill(block_0, block_0 + block, 0.0f);
+				std::fill(block_1, block_1 + block, 0.0f);
+				kernels[gain_step != 0 ? 1 : 0](region, v, block_0, block_1, block, v.gain, gain_step);
+
+				svf_coefficients c;
+				c.set(filter_cutoff_of(hot, v), hot.filter_q, sample_rate);
+				v.filter.process(hot.filter_type, c, block_0, block_1, out_0, out_1, block);
+			}
+			v.position *= scale;
+			v.increment *= scale;
+			v.gain = gain_end;
+
+			if (done) v.state = voice::OFF;
+
+			out_0 += block;
+			out_1 += block;
+			frames -= block;
+			frame_time += block;
+		}
+	}
+
+	//! The region of hot's mipmap level levels down (from 1), in that level's frames. Fills in and returns r
+	static inline const render_region &mipmap_region(const render_descriptor &hot, unsigned int level, render_region &r) {
+		const mipmap_level &l = hot.mipmaps[level - 1];
+		const double scale = 1.0 / (1u << level);
+		r.data_0 = l.begin_0();
+		r.data_1 = l.begin_1();
+		r.end_frame = hot.region.end_frame * scale;
+		r.loop_start_frame = hot.region.loop_start_frame * scale;
+		r.loop_end_frame = hot.region.loop_end_frame * scale;
+		return r;
+	}
 
-		const double mix = fmod(current_frame, 1.0);
-		const double one_minus_mix = 1.0 - mix;
+	//! floor(log2(increment)) for increments of 2 and above, 0 otherwise. Mipmap level k has 2^-k times the frames
+	static inline unsigned int mipmap_level_of(double increment) {
+		unsigned int level = 0;
+		while (increment >= 2.0 && level < render_descriptor::max_mipmap_levels) {
+			increment *= 0.5;
+			++level;
+		}
+		return level;
+	}
+
+	/**
+		Turn the voice OFF if it can not become audible anymore, i.e. its gain can
+		only fall from here on and the rest of the sample (including the loop) is
+		quieter than threshold (linear) at that gain.
+	*/
+	inline void retire_if_silent(voice &v, double threshold) {
+		retire_if_silent(hot, sample_->t, v, threshold);
+	}
+
+	//! The same for a generator with the render descriptor hot, playing s
+	static inline void retire_if_silent(const render_descriptor &hot, const sample &s, voice &v, double threshold) {
+		if (v.state == voice::OFF || v.envelope_rising) return;
 
-		const unsigned int floor_current_frame = std::min((unsigned int)floor(current_frame), sample_length - 1);
-		const unsigned int ceil_current_frame = std::min((unsigned int)ceil(current_frame), sample_length - 1);
+		unsigned int position = (unsigned int)v.position;
+		if (hot.looping) position = std::min(position, (unsigned int)hot.region.loop_start_frame);
 
-		out_0[frame] += g * (one_minus_mix * data_0[floor_current_frame] + mix * data_0[ceil_current_frame]);
-		out_1[frame] += g * (one_minus_mix * data_1[floor_current_frame] + mix * data_1[ceil_current_frame]);
+		if (v.gain * s.tail_peak(position) < threshold) v.state = voice::OFF;
 	}
 
 	protected:
 };
 
+//! A command setting parameter u of generator g to t and rebuilding g's render descriptor
+template<class U, class T>
+struct assign_parameter_fun {
+	generator &g;
+	U &u;
+	T t;
+
+	assign_parameter_fun(generator &g, U &u, const T& t) : g(g), u(u), t(t) { }
+
+	void operator()() { u = t; g.update(); }
+};
+
+template<class U, class T>
+assign_parameter_fun<U,T> 
+assign_parameter(generator &g, U &u, const T& t) {
+	return assign_parameter_fun<U, T>(g, u, t);
+}
+
+inline bool disposable_in_use(const generator &g) {
+	return g.bound_voices != 0;
+}
+
+//! Not counting the sample, which is a disposable of its own
+inline size_t disposable_memory(const generator &g) {
+	return sizeof(generator) + string_memory(g.name);
+}
+
 typedef disposable<generator> disposable_generator;
 typedef boost::shared_ptr<disposable<generator> > disposable_generator_ptr;
 
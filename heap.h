@@ -1,13 +1,14 @@
 #ifndef HEAP_HH
 #define HEAP_HH
 
-#include <list>
+#include <vector>
 #include <iostream>
 
 #include "disposable_base.h"
 
 struct heap {
-	std::list<boost::shared_ptr<disposable_base> > disposables;
+	//! A vector rather than a list, so adding a disposable does not allocate a node every time
+	std::vector<boost::shared_ptr<disposable_base> > disposables;
 
 	static heap* instance;
 
@@ -26,15 +27,54 @@ struct heap {
 		Note that this function has to be called in the same thread that writes commands, otherwise
 		references might go away between the construction of a disposable and binding it to a functor
 		that uses it.
+
+		Returns true if there are unreferenced disposables left which are still in_use(), i.e.
+		cleanup() should be called again a little later.
 	*/
-	void cleanup() {
-		for (std::list<boost::shared_ptr<disposable_base> >::iterator it = disposables.begin(); it != disposables.end();) {
+	bool cleanup() {
+		bool pending;
+		bool released;
+
+		//! Releasing a disposable can leave others unreferenced (e.g. the generators in a generator vector), so repeat until nothing changes
+		do {
+			pending = false;
+			released = false;
+
+			//! Release unreferenced disposables and compact the survivors in place
+			std::vector<boost::shared_ptr<disposable_base> >::iterator out = disposables.begin();
+			for (std::vector<boost::shared_ptr<disposable_base> >::iterator it = disposables.begin(); it != disposables.end(); ++it) {
+				if (it->unique() && !(*it)->in_use()) {
+					it->reset();
+					released = true;
+				} else {
+					if (it->unique()) pending = true;
+					if (out != it) out->swap(*it);
+					++out;
+				}
+			}	
+			disposables.erase(out, disposables.end());
+		} while (released);
+
+		return pending;
+	}
+
+	/**
+		Add up the memory of the disposables, split into the ones still referenced
+		and the ones only waiting for cleanup() (the reclaim backlog). Call this
+		in the same thread as cleanup().
+	*/
+	void memory(size_t &referenced, size_t &backlog, unsigned int &backlog_objects) const {
+		referenced = backlog = 0;
+		backlog_objects = 0;
+
+		for (std::vector<boost::shared_ptr<disposable_base> >::const_iterator it = disposables.begin(); it != disposables.end(); ++it) {
 			if (it->unique()) {
-				it = disposables.erase(it);
+				backlog += (*it)->memory();
+				++backlog_objects;
 			} else {
-				++it;
+				referenced += (*it)->memory();
 			}
-		}	
+		}
 	}
 
 	~heap() { instance = 0; }
@@ -8,6 +8,8 @@
 #include "generator.h"
 #include "engine.h"
 #include "keyboard_widget.h"
+#include "dial_widget.h"
+#include "controller_map.h"
 
 struct keyboard_channel_widget : public QWidget {
 	Q_OBJECT
@@ -16,13 +18,28 @@ struct keyboard_channel_widget : public QWidget {
 
 	QSpinBox *channel_spin;
 
+	dial_widget *tune;
+
 	public slots:
 		void channel_changed(int channel) {
 			engine::get()->write_command(assign(gen->t.channel, channel));
-			engine::get()->deferred_commands.write(boost::bind(&keyboard_channel_widget::update, this));
+			engine::get()->defer(boost::bind(&keyboard_channel_widget::update, this));
+		}
+
+		void tune_changed(double cents) {
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.tune, cents));
+		}
+
+		void learn_tune() {
+			engine::get()->learn(gen, PARAMETER_TUNE);
 		}
 
 	public:
+		//! Show a value the engine settled on for parameter (see controller_feedback)
+		void show_parameter(int parameter, double value) {
+			if (parameter == PARAMETER_TUNE) tune->show_value(value);
+		}
+
 		keyboard_channel_widget(disposable_generator_ptr gen, QWidget *parent = 0) :
 			QWidget(parent),
 			gen(gen) 
@@ -34,6 +51,14 @@ struct keyboard_channel_widget : public QWidget {
 			channel_spin->setValue(gen->t.channel);
 			layout->addWidget(channel_spin, 0);
 			connect(channel_spin, SIGNAL(valueChanged(int)), this, SLOT(channel_changed(int)));
+			tune = new dial_widget();
+			tune->set_min_value(-100);
+			tune->set_max_value(100);
+			tune->set_value(gen->t.tune);
+			tune->setToolTip("Fine tune (cents)");
+			layout->addWidget(tune, 0);
+			connect(tune, SIGNAL(valueChanged(double)), this, SLOT(tune_changed(double)));
+			connect(tune, SIGNAL(learn_requested()), this, SLOT(learn_tune()));
 			layout->addWidget(new keyboard_widget(gen), 1);
 			setLayout(layout);
 		}
@@ -99,14 +99,14 @@ struct keyboard_widget : public QWidget {
 			}
 
 			e->accept();
-			engine::get()->deferred_commands.write(boost::bind(&keyboard_widget::update, this));
+			engine::get()->defer(boost::bind(&keyboard_widget::update, this));
 		}
 
 		void mouseMoveEvent(QMouseEvent *e) {
 			if ((e->buttons() & Qt::LeftButton) && (e->modifiers() & Qt::ShiftModifier)) {
 				engine::get()->write_command(assign(gen->t.max_note, std::max((unsigned int)((double)(e->x())/width() * 128), gen->t.min_note)));
 				e->accept();
-				engine::get()->deferred_commands.write(boost::bind(&keyboard_widget::update, this));
+				engine::get()->defer(boost::bind(&keyboard_widget::update, this));
 			}
 
 			// QApplication::processEvents();
@@ -119,7 +119,7 @@ struct keyboard_widget : public QWidget {
 				engine::get()->write_command(assign(gen->t.min_note, (double)(e->x())/width() * 128));
 				engine::get()->write_command(assign(gen->t.max_note, (double)(e->x())/width() * 128));
 				e->accept();
-				engine::get()->deferred_commands.write(boost::bind(&keyboard_widget::update, this));
+				engine::get()->defer(boost::bind(&keyboard_widget::update, this));
 			}
 		}
 
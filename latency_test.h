@@ -0,0 +1,212 @@
+#ifndef JASS_LATENCY_TEST_HH
+#define JASS_LATENCY_TEST_HH
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include <jack/ringbuffer.h>
+
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <iomanip>
+#include <string>
+
+#include <stdint.h>
+
+/**
+	Measures the MIDI in to audio out latency through a loopback: the process
+	thread sends a note on through a MIDI out port, which is routed back into
+	the engine's MIDI in, and waits for the click generator's output to show up
+	on an audio in port. The time from sending to the first sample above
+	threshold is passed to the main thread like rt_log does.
+
+	The notes are sent at random offsets within the period, so a note on which
+	is not placed at its event's time shows up as jitter.
+*/
+struct latency_test {
+	struct record {
+		//! In frames, -1 if the click did not arrive within timeout_frames
+		int latency;
+		jack_nframes_t period;
+	};
+
+	jack_ringbuffer_t *jack_ringbuffer;
+
+	//! The note the click generator listens to
+	unsigned char channel;
+	unsigned char note;
+
+	float threshold;
+
+	//! The time between a detected click and the next note on, plus up to interval_frames / 2 at random
+	jack_nframes_t interval_frames;
+	jack_nframes_t timeout_frames;
+
+	//! The rest is only used in the process thread
+	bool running;
+	bool waiting;
+	bool note_off_pending;
+	bool started;
+	jack_nframes_t next_note_frame;
+	jack_nframes_t sent_frame;
+	uint32_t random;
+
+	latency_test(unsigned int size = 1024) :
+		channel(15),
+		note(60),
+		threshold(0.01),
+		interval_frames(4800),
+		timeout_frames(48000),
+		running(false),
+		waiting(false),
+		note_off_pending(false),
+		started(false),
+		next_note_frame(0),
+		sent_frame(0),
+		random(4711)
+	{
+		jack_ringbuffer = jack_ringbuffer_create(sizeof(record) * size);
+	}
+
+	~latency_test() {
+		jack_ringbuffer_free(jack_ringbuffer);
+	}
+
+	//! Run this in the process thread (i.e. through write_command())
+	void start(jack_nframes_t interval, jack_nframes_t timeout) {
+		interval_frames = interval;
+		timeout_frames = timeout;
+		running = true;
+		waiting = false;
+		note_off_pending = false;
+		started = true;
+	}
+
+	//! Run this in the process thread (i.e. through write_command())
+	void stop() {
+		running = false;
+	}
+
+	/**
+		Call this once per period in the process thread. midi_out_buf has to be
+		cleared already, in is the audio coming back from the loopback.
+	*/
+	void process(void *midi_out_buf, const float *in, const jack_nframes_t nframes, const jack_nframes_t frame_time) {
+		if (!running) return;
+
+		if (started) {
+			next_note_frame = frame_time;
+			started = false;
+		}
+
+		if (note_off_pending) {
+			const jack_midi_data_t note_off[3] = { (jack_midi_data_t)(0x80 | channel), note, 0 };
+			jack_midi_event_write(midi_out_buf, 0, note_off, 3);
+			note_off_pending = false;
+		}
+
+		if (waiting) {
+			for (jack_nframes_t frame = 0; frame < nframes; ++frame) {
+				if (fabs(in[frame]) > threshold) {
+					push(frame_time + frame - sent_frame, nframes);
+					schedule(frame_time + frame);
+					break;
+				}
+			}
+
+			if (waiting && frame_time + nframes - sent_frame > timeout_frames) {
+				push(-1, nframes);
+				schedule(frame_time + nframes);
+			}
+		}
+
+		//! A signed difference, so this works when the frame time wraps
+		const int32_t ahead = (int32_t)(next_note_frame - frame_time);
+		if (!waiting && ahead < (int32_t)nframes) {
+			const jack_nframes_t offset = ahead > 0 ? ahead : 0;
+			const jack_midi_data_t note_on[3] = { (jack_midi_data_t)(0x90 | channel), note, 127 };
+			if (jack_midi_event_write(midi_out_buf, offset, note_on, 3) == 0) {
+				sent_frame = frame_time + offset;
+				waiting = true;
+			}
+		}
+	}
+
+	//! Only call this in the main thread. Returns false if there is no record
+	bool read(record &r) {
+		if (jack_ringbuffer_read_space(jack_ringbuffer) < sizeof(record)) return false;
+		jack_ringbuffer_read(jack_ringbuffer, (char*)&r, sizeof(record));
+		return true;
+	}
+
+	protected:
+		void schedule(jack_nframes_t now) {
+			waiting = false;
+			note_off_pending = true;
+
+			random = random * 1664525u + 1013904223u;
+			next_note_frame = now + interval_frames + (random >> 8) % (interval_frames / 2 + 1);
+		}
+
+		//! Drops the record if the main thread is behind
+		void push(int latency, jack_nframes_t period) {
+			if (jack_ringbuffer_write_space(jack_ringbuffer) < sizeof(record)) return;
+
+			record r;
+			r.latency = latency;
+			r.period = period;
+			jack_ringbuffer_write(jack_ringbuffer, (const char*)&r, sizeof(record));
+		}
+
+	private:
+		latency_test(const latency_test&);
+		latency_test &operator=(const latency_test&);
+};
+
+//! Collects the latencies of one configuration and prints them
+struct latency_histogram {
+	std::map<int, unsigned int> counts;
+	unsigned int timeouts;
+	unsigned int measurements;
+
+	latency_histogram() : timeouts(0), measurements(0) { }
+
+	void add(int latency) {
+		if (latency < 0) {
+			++timeouts;
+		} else {
+			++counts[latency];
+			++measurements;
+		}
+	}
+
+	void print(std::ostream &o, const std::string &mode, jack_nframes_t period, double sample_rate) const {
+		o << "mode: " << mode << ", period: " << period << ", measurements: " << measurements << ", timeouts: " << timeouts << std::endl;
+		if (counts.empty()) return;
+
+		double sum = 0, sum_of_squares = 0;
+		unsigned int peak = 0;
+		for (std::map<int, unsigned int>::const_iterator it = counts.begin(); it != counts.end(); ++it) {
+			sum += (double)it->first * it->second;
+			sum_of_squares += (double)it->first * it->first * it->second;
+			peak = std::max(peak, it->second);
+		}
+
+		const double mean = sum / measurements;
+		const double deviation = sqrt(std::max(0.0, sum_of_squares / measurements - mean * mean));
+		const int min = counts.begin()->first;
+		const int max = counts.rbegin()->first;
+
+		o << std::fixed << std::setprecision(3)
+			<< "latency (frames): min " << min << ", mean " << mean << ", max " << max
+			<< " (" << 1000.0 * mean / sample_rate << " ms, " << mean / period << " periods)" << std::endl
+			<< "jitter (frames): max - min " << max - min << ", standard deviation " << deviation << std::endl;
+
+		for (std::map<int, unsigned int>::const_iterator it = counts.begin(); it != counts.end(); ++it) {
+			o << std::setw(8) << it->first << std::setw(8) << it->second << " " << std::string((it->second * 50 + peak - 1) / peak, '#') << std::endl;
+		}
+	}
+};
+
+#endif
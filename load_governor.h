@@ -0,0 +1,129 @@
+#ifndef JASS_LOAD_GOVERNOR_HH
+#define JASS_LOAD_GOVERNOR_HH
+
+#include <jack/jack.h>
+
+#include <algorithm>
+
+#include <stdint.h>
+
+#include "render_kernel.h"
+#include "trace.h"
+
+/**
+	Keeps the process callback within its period by trading quality for time.
+	The load is the time the callback took divided by the period's duration.
+	Each period above high_load raises the level by one, each restore_frames
+	spent below low_load lower it by one. The levels add up:
+
+	1. the generators read their samples with linear interpolation, whatever theirs is
+	2. voices are retired at a silence threshold silence_boost times higher
+	3. the polyphony is halved and the oldest voices are stolen
+	4. the polyphony is quartered
+
+	Only the process thread uses this. engine_core asks it for the settings
+	of the current level and reports the level changes through rt_log.
+*/
+struct load_governor {
+	enum { MAX_LEVEL = 4 };
+
+	bool enabled;
+
+	//! Fractions of the period
+	double high_load;
+	double low_load;
+
+	//! How long the load has to stay below low_load before stepping back a level
+	jack_nframes_t restore_frames;
+
+	//! A linear factor, 100 is 40 dB
+	double silence_boost;
+
+	unsigned int level;
+
+	//! The load of the last period, in percent
+	unsigned int load_percent;
+
+	//! The frames processed since the load was last above low_load
+	jack_nframes_t calm_frames;
+
+	load_governor() :
+		enabled(false),
+		high_load(0.75),
+		low_load(0.5),
+		restore_frames(48000),
+		silence_boost(100.0),
+		level(0),
+		load_percent(0),
+		calm_frames(0)
+	{
+
+	}
+
+	//! Returns the start of a measurement
+	static inline uint64_t begin() {
+		return trace::monotonic_ns();
+	}
+
+	/**
+		Call this at the end of each period with the begin() of the period.
+		Returns true if the level changed.
+	*/
+	inline bool update(uint64_t begin, jack_nframes_t nframes, jack_nframes_t rate) {
+		const double budget_ns = (double)nframes * 1e9 / (double)rate;
+		const double load = (double)(trace::monotonic_ns() - begin) / budget_ns;
+		load_percent = (unsigned int)(100.0 * load);
+
+		if (!enabled) return reset();
+
+		if (load > high_load) {
+			calm_frames = 0;
+			if (level < MAX_LEVEL) {
+				++level;
+				return true;
+			}
+			return false;
+		}
+
+		if (load > low_load) {
+			calm_frames = 0;
+			return false;
+		}
+
+		calm_frames += nframes;
+		if (level > 0 && calm_frames >= restore_frames) {
+			calm_frames = 0;
+			--level;
+			return true;
+		}
+		return false;
+	}
+
+	//! Back to full quality, e.g. when JACK freewheels. Returns true if the level changed
+	inline bool reset() {
+		calm_frames = 0;
+		if (level == 0) return false;
+		level = 0;
+		return true;
+	}
+
+	inline int max_interpolation(int wanted) const {
+		return level >= 1 ? (int)LINEAR_INTERPOLATION : wanted;
+	}
+
+	inline double silence_threshold(double wanted) const {
+		return level >= 2 ? wanted * silence_boost : wanted;
+	}
+
+	inline unsigned int polyphony(unsigned int wanted) const {
+		if (level >= 4) return std::max(wanted / 4, 1u);
+		if (level >= 3) return std::max(wanted / 2, 1u);
+		return wanted;
+	}
+
+	inline bool steal_oldest() const {
+		return level >= 3;
+	}
+};
+
+#endif
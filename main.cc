@@ -1,6 +1,9 @@
 #include <iostream>
 #include <vector>
 #include <functional>
+#include <sstream>
+
+#include <unistd.h>
 
 #include <jack/jack.h>
 
@@ -19,26 +22,160 @@
 
 #include "main_window.h"
 #include "qfunctor.h"
-#include "timed_functor.h"
+#include "notified_functor.h"
+#include "event_fd.h"
 
 #include "engine.h"
+#include "synthetic.h"
+
+//! Used to communicate the receiption of SIGUSR1 to the check_signalled function. write() is async signal safe
+event_fd *save_signal_event = 0;
+
+//! Dito for SIGUSR2 which dumps the engine trace
+event_fd *trace_signal_event = 0;
 
-//! A global variable to communicate the receiption of SIGUSR1 to the check_signalled function
-bool signalled = false;
 void signal_handler(int signum) {
-	if (signum == SIGUSR1) {
-		signalled = true;
+	if (signum == SIGUSR1 && save_signal_event) {
+		save_signal_event->signal();
+	}
+	if (signum == SIGUSR2 && trace_signal_event) {
+		trace_signal_event->signal();
 	}
 }
 
-//! Called periodically in GUI thread to see whether we received SIGUSR1 (ladish)
+//! Called in GUI thread when we received SIGUSR1 (ladish)
 void check_signalled(main_window &w) {
-	if (signalled) {
-		signalled = false;
+	if (save_signal_event->drain()) {
 		w.save_setup();
 	}
 }
 
+//! Called in GUI thread when we received SIGUSR2
+void check_trace_signalled(main_window &w) {
+	if (trace_signal_event->drain()) {
+		w.dump_trace();
+	}
+}
+
+//! Clean the heap. If disposables are only kept alive by playing voices, try again a little later
+void cleanup_heap(QTimer &retry_timer) {
+	if (heap::get()->cleanup()) retry_timer.start();
+}
+
+//! Called in GUI thread whenever the engine signalled acknowledgements
+void acknowledge(engine &e, QTimer &cleanup_timer) {
+	e.check_acknowledgements();
+	cleanup_heap(cleanup_timer);
+}
+
+/**
+	The latency self test (--latency-test): plays a click generator through
+	a loopback for each period size, first with the engine idle and then with
+	load voices playing inaudibly, and prints a latency histogram for each.
+*/
+int run_latency_test(engine &e, std::vector<unsigned int> periods, unsigned int notes, unsigned int load, bool connect) {
+	if (!e.active) {
+		std::cerr << "The engine is not running" << std::endl;
+		return 1;
+	}
+
+	if (!e.enable_latency_test()) {
+		std::cerr << "Couldn't register the latency test ports" << std::endl;
+		return 1;
+	}
+
+	if (connect) {
+		if (
+			jack_connect(e.jack_client, jack_port_name(e.latency_out), jack_port_name(e.midi_in)) != 0
+			|| jack_connect(e.jack_client, jack_port_name(e.out_0), jack_port_name(e.latency_in)) != 0
+		) {
+			std::cerr << "Couldn't connect the loopback" << std::endl;
+			return 1;
+		}
+	} else {
+		std::cout 
+			<< "Waiting for " << jack_port_name(e.latency_out) << " to reach " << jack_port_name(e.midi_in) 
+			<< " and " << jack_port_name(e.out_0) << " to reach " << jack_port_name(e.latency_in) << std::endl;
+	}
+
+	const double rate = e.sample_rate;
+	latency_test &t = e.latency_test_;
+
+	//! A 10 ms burst. The envelope ramps up from 0, so the output crosses the threshold one frame after the note on
+	disposable_generator_ptr click = disposable_generator::create(generator("click", disposable_sample::create(sample("click", std::vector<float>((unsigned int)(rate / 100), 1.0f)))));
+	click->t.channel = t.channel;
+	click->t.note = click->t.min_note = click->t.max_note = t.note;
+	click->t.attack_g = 0.0001;
+	click->t.release_g = 0.001;
+	click->t.update();
+
+	//! The load plays on another channel at -100 dB, well below the threshold. Nothing may retire it
+	lcg random(4711);
+	disposable_generator_ptr drone = disposable_generator::create(generator("drone", synthetic_sample("drone", (unsigned int)rate, 2, 220, rate, random)));
+	drone->t.channel = (t.channel + 15) % 16;
+	drone->t.looping = true;
+	drone->t.loop_start = 0.2;
+	drone->t.loop_end = 0.3;
+	drone->t.gain = -100;
+	drone->t.update();
+
+	disposable_generator_vector_ptr gens = disposable_generator_vector::create(generator_vector());
+	gens->t.push_back(click);
+	gens->t.push_back(drone);
+
+	const unsigned int polyphony = std::min(load, 128u) + 16;
+	e.write_command(assign(e.gens, gens));
+	e.write_command(boost::bind(&engine::set_voices, boost::ref(e), engine::create_voices(polyphony), polyphony));
+	e.write_command(assign(e.silence_threshold, 0.0));
+
+	const jack_nframes_t original_period = jack_get_buffer_size(e.jack_client);
+	if (periods.empty()) periods.push_back(original_period);
+
+	for (unsigned int mode = 0; mode < (load > 0 ? 2u : 1u); ++mode) {
+		std::stringstream mode_name;
+		if (mode == 0) {
+			mode_name << "idle";
+		} else {
+			mode_name << "loaded (" << std::min(load, 128u) << " voices)";
+			for (unsigned int note = 0; note < std::min(load, 128u); ++note) {
+				e.write_command(boost::bind(&engine::process_note_on, boost::ref(e), 0, note, 100, drone->t.channel));
+			}
+		}
+
+		for (unsigned int index = 0; index < periods.size(); ++index) {
+			const jack_nframes_t period = periods[index];
+			if (jack_get_buffer_size(e.jack_client) != period && jack_set_buffer_size(e.jack_client, period) != 0) {
+				std::cerr << "Couldn't set the period size to " << period << std::endl;
+				continue;
+			}
+
+			//! Let things settle and drop what is left from the last run
+			usleep(200000);
+			latency_test::record r;
+			while (t.read(r)) { }
+
+			e.write_command(boost::bind(&latency_test::start, &t, (jack_nframes_t)(rate / 10), (jack_nframes_t)rate));
+
+			latency_histogram h;
+			while (e.active && h.measurements + h.timeouts < notes) {
+				usleep(10000);
+				e.check_acknowledgements();
+				while (t.read(r)) {
+					if (r.period == period) h.add(r.latency);
+				}
+			}
+
+			e.write_command(boost::bind(&latency_test::stop, &t));
+			h.print(std::cout, mode_name.str(), period, rate);
+			std::cout << std::endl;
+		}
+	}
+
+	if (jack_get_buffer_size(e.jack_client) != original_period) jack_set_buffer_size(e.jack_client, original_period);
+
+	return 0;
+}
+
 namespace po = boost::program_options;
 
 int main(int argc, char **argv) {
@@ -52,6 +189,22 @@ int main(int argc, char **argv) {
 	desc.add_options()
 		("help,h", "Produce this help message")
 		("UUID,U", po::value<std::string>(), "jack session UUID")
+		("log-file,l", po::value<std::string>(), "Append the messages of the engine to this file, too")
+		("print-memory", "Print a report of the memory used to stdout once the setup is loaded")
+		("stats-file", po::value<std::string>(), "Append the CPU share of each generator to this file every second. Needs a build with -DJASS_CPU_STATS=1")
+		("trace,t", "Record what the engine does. Send SIGUSR2 or use Help -> Dump Engine Trace to write the recent past to a file. Needs a build with -DJASS_TRACE=1")
+		("freewheel-interpolation", po::value<std::string>()->default_value(interpolation_names[render_profile::freewheel().min_interpolation]), "The least interpolation while JACK freewheels (linear, cubic, sinc8, sinc16 or sinc32)")
+		("freewheel-voice-limits", "Apply the polyphony, the generators' voice limits and the early retirement of silent voices while JACK freewheels, too")
+		("no-load-governor", "Never lower the quality when the process callback gets close to the end of its period")
+		("load-high", po::value<double>()->default_value(load_governor().high_load), "The load (a fraction of the period) above which the load governor lowers the quality by a level")
+		("load-low", po::value<double>()->default_value(load_governor().low_load), "The load below which the load governor restores the quality, a level per second")
+		("prerender-releases", "Render the release tails of voices ahead of time in a thread of its own, the process thread only mixes them in")
+		("prerender-voices", po::value<unsigned int>()->default_value(16), "The number of release tails prerendered at once")
+		("latency-test", "Measure the MIDI in to audio out latency instead of starting the GUI. Registers the ports latency_out and latency_in and connects them to in and out_0")
+		("latency-test-periods", po::value<std::vector<unsigned int> >()->multitoken(), "The period sizes to measure. The default is the current one")
+		("latency-test-notes", po::value<unsigned int>()->default_value(100), "Measurements per period size and engine mode")
+		("latency-test-load", po::value<unsigned int>()->default_value(64), "Voices playing in the loaded runs (0 - 128), 0 skips them")
+		("latency-test-no-connect", "Leave the loopback to the user, e.g. to include MIDI and audio hardware")
 		("state,s", po::value<std::vector<std::string> >(), "Load state from file arg1, arg2, arg3,... Note that this is a positional argument, i.e. just jass state.xml loads the state file as well. If the environment variable LADISH_APP_NAME is set, then do not exit if the file is not found and set the current file name to the arg.")
 	;
 
@@ -71,6 +224,41 @@ int main(int argc, char **argv) {
 		const char *uuid = 0;
 		if (vm.count("UUID")) uuid = vm["UUID"].as<std::string>().c_str();
 		engine &e = *engine::get(uuid);
+		if (vm.count("trace")) e.trace_.enable();
+
+		render_profile freewheel_profile = render_profile::freewheel();
+		freewheel_profile.min_interpolation = interpolation_of_name(vm["freewheel-interpolation"].as<std::string>());
+		if (freewheel_profile.min_interpolation < 0) {
+			std::cerr << "Unknown interpolation: " << vm["freewheel-interpolation"].as<std::string>() << std::endl;
+			delete &e;
+			delete heap::get();
+			return 1;
+		}
+		if (vm.count("freewheel-voice-limits")) freewheel_profile.voice_limits = freewheel_profile.retire_silent = true;
+		e.write_command(assign(e.freewheel_profile, freewheel_profile));
+
+		if (vm.count("no-load-governor")) e.write_command(assign(e.governor_.enabled, false));
+		e.write_command(assign(e.governor_.high_load, vm["load-high"].as<double>()));
+		e.write_command(assign(e.governor_.low_load, std::min(vm["load-low"].as<double>(), vm["load-high"].as<double>())));
+
+		if (vm.count("prerender-releases")) e.start_prerender(vm["prerender-voices"].as<unsigned int>());
+
+		if (vm.count("latency-test")) {
+			std::vector<unsigned int> periods;
+			if (vm.count("latency-test-periods")) periods = vm["latency-test-periods"].as<std::vector<unsigned int> >();
+
+			const int result = run_latency_test(
+				e, 
+				periods, 
+				vm["latency-test-notes"].as<unsigned int>(), 
+				vm["latency-test-load"].as<unsigned int>(), 
+				vm.count("latency-test-no-connect") == 0
+			);
+
+			delete &e;
+			delete heap::get();
+			return result;
+		}
 
 		main_window w(e);
 #ifndef NO_JACK_SESSION
@@ -82,8 +270,15 @@ int main(int argc, char **argv) {
 		);
 #endif
 		//! register SIGUSR1 for ladish session support
+		event_fd save_event;
+		save_signal_event = &save_event;
 		signal(SIGUSR1, signal_handler);
 
+		//! and SIGUSR2 for dumping the trace
+		event_fd trace_event;
+		trace_signal_event = &trace_event;
+		signal(SIGUSR2, signal_handler);
+
 		w.setEnabled(false);
 		w.show();
 
@@ -91,17 +286,40 @@ int main(int argc, char **argv) {
 
 		if (vm.count("state")) w.load_setup(vm["state"].as<std::vector<std::string> >()[0]);
 
-		//! Register a timed function to clean the heap
-		timed_functor tf1(boost::bind(&heap::cleanup, heap::get()), 100);
+		//! Deferred, so it runs once the engine took over the setup
+		if (vm.count("print-memory")) e.defer(boost::bind(&main_window::print_memory_report, &w));
+
+		//! Only runs while disposables are waiting for voices to stop
+		QTimer cleanup_timer;
+		cleanup_timer.setSingleShot(true);
+		cleanup_timer.setInterval(100);
+		qfunctor cleanup_functor(boost::bind(cleanup_heap, boost::ref(cleanup_timer)));
+		QObject::connect(&cleanup_timer, SIGNAL(timeout()), &cleanup_functor, SLOT(exec()));
 
-		//! This function checks for acknowledgements of the engine and reenables the GUI
-		timed_functor tf2(boost::bind(&engine::check_acknowledgements, &e), 100);
+		//! This function checks for acknowledgements of the engine, runs the deferred commands (which reenable the GUI) and cleans the heap
+		notified_functor nf1(boost::bind(acknowledge, boost::ref(e), boost::ref(cleanup_timer)), e.ack_event.fd);
 
 		//! This one checks for ladish save signals..
-		timed_functor tf3(boost::bind(check_signalled, boost::ref(w)), 1000);
+		notified_functor nf2(boost::bind(check_signalled, boost::ref(w)), save_event.fd);
+		notified_functor nf4(boost::bind(check_trace_signalled, boost::ref(w)), trace_event.fd);
+
+		//! And this one formats the messages from the process thread
+		if (vm.count("log-file")) w.open_log_file(vm["log-file"].as<std::string>());
+		if (vm.count("stats-file")) w.open_stats_file(vm["stats-file"].as<std::string>());
+		notified_functor nf3(boost::bind(&rt_log::drain, &e.log_, boost::function<void(const std::string&)>(boost::bind(&main_window::append_engine_log, &w, _1))), e.log_.event.fd);
+
+		//! Hands finished mipmaps to the generators
+		notified_functor nf6(boost::bind(&main_window::install_mipmaps, &w), w.mipmap_builder_.done.fd);
+
+		//! Updates widgets of parameters moved by MIDI controllers and finishes MIDI learn
+		notified_functor nf5(boost::bind(&main_window::drain_controller_feedback, &w), e.controller_feedback_.event.fd);
 
 		w.setEnabled(true);
 		q_application.exec();
+		signal(SIGUSR1, SIG_DFL);
+		signal(SIGUSR2, SIG_DFL);
+		save_signal_event = 0;
+		trace_signal_event = 0;
 		delete &e;
 	}
 	std::cout << "exiting" << std::endl;
@@ -3,9 +3,15 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <fstream>
 #include <cstdlib>
+#include <cstdio>
+#include <ctime>
 #include <iterator>
+#include <sstream>
+
+#include <unistd.h>
 
 #include <QMainWindow>
 #include <QSettings>
@@ -25,6 +31,7 @@
 #include <QFileDialog>
 #include <QTextEdit>
 #include <QDial>
+#include <QTimer>
 
 #include "jass.hxx"
 
@@ -36,6 +43,8 @@
 #include "velocity_widget.h"
 #include "sample_range_widget.h"
 #include "mute_widget.h"
+#include "filter_widget.h"
+#include "memory_report.h"
 
 class main_window : public QMainWindow {
 	Q_OBJECT
@@ -50,9 +59,98 @@ class main_window : public QMainWindow {
 	
 	engine &engine_;
 
+	//! Optional copy of the engine log
+	std::ofstream log_file;
+
+	//! The columns of the generator table, see update_generator_row()
+	enum { ADSR_COLUMN = 1, FILTER_COLUMN = 2, KEYBOARD_CHANNEL_COLUMN = 4, VELOCITY_COLUMN = 5, CPU_COLUMN = 8 };
+
+	struct cpu_sample {
+		uint64_t ticks;
+		uint64_t voice_frames;
+	};
+
+	//! The totals at the last update_cpu_stats(), to take the differences
+	std::map<unsigned int, cpu_sample> last_cpu_samples;
+	cpu_sample last_process_cpu_sample;
+	uint64_t last_cpu_stats_ticks;
+
+	QTimer *cpu_stats_timer;
+
+	//! Optional CSV file the CPU stats are appended to
+	std::ofstream stats_file;
+
 	public:
 		std::string setup_file_name;
 
+		//! Build at most this many octaves of mipmaps per sample, 0 for none. See build_mipmaps()
+		unsigned int mipmap_octaves;
+
+		mipmap_builder mipmap_builder_;
+
+		/**
+			Queue the mipmaps the generators need (as far as mipmap_octaves allows)
+			for each sample that has none yet. A sample needs as many octaves as its
+			generators transpose it up, including the pitch bend range.
+		*/
+		void build_mipmaps() {
+			if (mipmap_octaves == 0) return;
+
+			std::map<disposable_sample_ptr, int> max_cents;
+			for (generator_vector::iterator it = engine_.gens->t.begin(); it != engine_.gens->t.end(); ++it) {
+				const generator &g = (*it)->t;
+				if (g.mipmaps_ || mipmap_builder_.building(g.sample_)) continue;
+
+				const int cents = ((int)g.max_note - (int)g.note) * 100 + (int)floor(g.tune + 0.5) + (int)engine_.pitch_bend_range * 100;
+				if (max_cents.find(g.sample_) == max_cents.end() || cents > max_cents[g.sample_]) max_cents[g.sample_] = cents;
+			}
+
+			for (std::map<disposable_sample_ptr, int>::iterator it = max_cents.begin(); it != max_cents.end(); ++it) {
+				const unsigned int octaves = std::min(std::min(mipmap_octaves, (unsigned int)render_descriptor::max_mipmap_levels), (unsigned int)std::max(it->second / 1200, 0));
+				if (octaves == 0) continue;
+
+				mipmap_builder_.add(it->first, disposable_mipmaps::create(), octaves);
+			}
+		}
+
+		//! Hand the mipmaps built since the last call to the generators playing their samples
+		void install_mipmaps() {
+			const std::vector<mipmap_builder::job> jobs = mipmap_builder_.take_finished();
+			for (unsigned int index = 0; index < jobs.size(); ++index) {
+				for (generator_vector::iterator it = engine_.gens->t.begin(); it != engine_.gens->t.end(); ++it) {
+					if ((*it)->t.sample_ != jobs[index].source || (*it)->t.mipmaps_) continue;
+					engine_.write_command(assign_parameter((*it)->t, (*it)->t.mipmaps_, jobs[index].mipmaps));
+				}
+				log_text_edit->append(QString("Built %1 octaves of mipmaps for %2").arg(jobs[index].octaves).arg(jobs[index].source->t.file_name.c_str()));
+			}
+		}
+
+		void open_log_file(const std::string &file_name) {
+			log_file.open(file_name.c_str(), std::ios::app);
+			if (!log_file.good()) log_text_edit->append(("something went wrong opening the log file: " + file_name).c_str());
+		}
+
+		void open_stats_file(const std::string &file_name) {
+#ifndef JASS_CPU_STATS
+			log_text_edit->append("This jass was built without CPU stats. Rebuild with -DJASS_CPU_STATS=1 to get a stats file");
+#else
+			stats_file.open(file_name.c_str(), std::ios::app);
+			if (!stats_file.good()) log_text_edit->append(("something went wrong opening the stats file: " + file_name).c_str());
+			else stats_file << "time,generator,cpu_percent,ns_per_voice_frame" << std::endl;
+#endif
+		}
+
+		//! Write memory_report() to stdout, e.g. for --print-memory
+		void print_memory_report() {
+			memory_report(std::cout, engine_);
+		}
+
+		//! Called in the GUI thread for each message drained from engine::log_
+		void append_engine_log(const std::string &line) {
+			log_text_edit->append(line.c_str());
+			if (log_file.is_open()) log_file << line << std::endl;
+		}
+
 	public slots:
 		void audit_sample_file(const QString &path) {
 			if(!(QApplication::keyboardModifiers() & Qt::ControlModifier)) return;
@@ -69,7 +167,7 @@ class main_window : public QMainWindow {
 				setEnabled(false);
 					engine_.write_command(assign(engine_.auditor_gen, p));
 					engine_.write_command(boost::bind(&engine::play_auditor, boost::ref(engine_)));
-				engine_.deferred_commands.write(boost::bind(&main_window::setEnabled, this, true));
+				engine_.defer(boost::bind(&main_window::setEnabled, this, true));
 
 				log_text_edit->append("Loaded audit sample: ");
 				log_text_edit->append(path);
@@ -91,7 +189,8 @@ class main_window : public QMainWindow {
 		void load_sample_file() {
 			if(QApplication::keyboardModifiers() & Qt::AltModifier) return;
 
-			disposable_generator_list_ptr l = disposable_generator_list::create(engine_.gens->t);
+			disposable_generator_vector_ptr l = disposable_generator_vector::create(engine_.gens->t);
+			l->t.reserve(l->t.size() + file_dialog->selectedFiles().size());
 
 			for (unsigned int index = 0; index < file_dialog->selectedFiles().size(); ++index) {
 				try {
@@ -114,8 +213,9 @@ class main_window : public QMainWindow {
 			}
 			setEnabled(false);
 				engine_.write_command(assign(engine_.gens, l));
-				engine_.deferred_commands.write(boost::bind(&main_window::update_generator_table, this));
-			engine_.deferred_commands.write(boost::bind(&main_window::setEnabled, this, true));
+				engine_.defer(boost::bind(&main_window::update_generator_table, this));
+				engine_.defer(boost::bind(&main_window::build_mipmaps, this));
+			engine_.defer(boost::bind(&main_window::setEnabled, this, true));
 		}
 		
 #ifndef NO_JACK_SESSION
@@ -144,8 +244,13 @@ class main_window : public QMainWindow {
 		void save_setup(const std::string &file_name) {
 			try {
 				std::ofstream f(file_name.c_str());
-				Jass::Jass j(engine_.voices->t.size());
-				for(generator_list::iterator it = engine_.gens->t.begin(); it != engine_.gens->t.end(); ++it) {
+				Jass::Jass j(engine_.polyphony);
+				const char *policies[] = { "oldest", "quietest", "releasing-first" };
+				j.VoiceStealing() = Jass::VoiceStealing(policies[engine_.voice_stealing]);
+				j.SilenceThreshold() = 20.0 * log10(engine_.silence_threshold);
+				j.PitchBendRange() = engine_.pitch_bend_range;
+				j.MipmapOctaves() = mipmap_octaves;
+				for(generator_vector::iterator it = engine_.gens->t.begin(); it != engine_.gens->t.end(); ++it) {
 					Jass::Generator jg((*it)->t.name, (*it)->t.sample_->t.file_name);
 					jg.Name() = (*it)->t.name;
 					jg.Sample() = (*it)->t.sample_->t.file_name;
@@ -167,6 +272,16 @@ class main_window : public QMainWindow {
 					jg.DecayGain() = (*it)->t.decay_g;
 					jg.SustainGain() = (*it)->t.sustain_g;
 					jg.ReleaseGain() = (*it)->t.release_g;
+					jg.MaxVoices() = (*it)->t.max_voices;
+					jg.ChokeGroup() = (*it)->t.choke_group;
+					jg.Retrigger() = (*it)->t.retrigger;
+					jg.Tune() = (*it)->t.tune;
+					jg.FilterType() = Jass::FilterType(filter_type_names[(*it)->t.filter_type]);
+					jg.FilterCutoff() = (*it)->t.filter_cutoff;
+					jg.FilterQ() = (*it)->t.filter_q;
+					jg.FilterVelocityAmount() = (*it)->t.filter_velocity_amount;
+					jg.FilterEnvelopeAmount() = (*it)->t.filter_envelope_amount;
+					jg.Interpolation() = Jass::Interpolation(interpolation_names[(*it)->t.interpolation]);
 
 #if 0
 					j.Generator().push_back(Jass::Generator(
@@ -194,6 +309,22 @@ class main_window : public QMainWindow {
 #endif
 					j.Generator().push_back(jg);
 				}
+				for (unsigned int index = 0; index < engine_.controller_map->t.size(); ++index) {
+					const controller_mapping &c = engine_.controller_map->t[index];
+					const int row = generator_row(c.gen->t.id);
+					if (row < 0) continue;
+
+					Jass::ControllerMapping jc(
+						c.channel, 
+						c.controller, 
+						row, 
+						Jass::ControllerParameter(controller_parameter_names[c.parameter]), 
+						c.min, 
+						c.max
+					);
+					jc.Curve() = Jass::ControllerCurve(controller_curve_names[c.curve]);
+					j.ControllerMapping().push_back(jc);
+				}
 				Jass::Jass_(f, j);
 			} catch (...) {
 				log_text_edit->append(("something went wrong saving the setup: " + file_name).c_str());
@@ -227,15 +358,8 @@ class main_window : public QMainWindow {
 			generator_table->setRowCount(engine_.gens->t.size());
 
 			int row = 0;
-			for (generator_list::iterator it = engine_.gens->t.begin(); it != engine_.gens->t.end(); ++it) {
-				int col = 0;
-				generator_table->setCellWidget(row, col++, new mute_widget(*it));
-				generator_table->setCellWidget(row, col++, new adsr_widget(*it));
-				generator_table->setItem(row, col++, new QTableWidgetItem(QString((*it)->t.name.c_str())));
-				generator_table->setCellWidget(row, col++, new keyboard_channel_widget((*it)));
-				generator_table->setCellWidget(row, col++, new velocity_widget((*it)));
-				generator_table->setCellWidget(row, col++, new sample_range_widget((*it)));
-				generator_table->setItem(row, col++, new QTableWidgetItem(QString((*it)->t.sample_->t.file_name.c_str())));
+			for (generator_vector::iterator it = engine_.gens->t.begin(); it != engine_.gens->t.end(); ++it) {
+				update_generator_row(row, *it);
 				//generator_widget *w = new generator_widget(*it);
 				//generator_table->setCellWidget(row++, 0, w);
 				row++;
@@ -244,6 +368,127 @@ class main_window : public QMainWindow {
 			generator_table->resizeColumnsToContents();
 			//generator_table->resizeRowsToContents();
 		}
+
+		void update_generator_row(int row, disposable_generator_ptr gen) {
+			int col = 0;
+			generator_table->setCellWidget(row, col++, new mute_widget(gen));
+			generator_table->setCellWidget(row, col++, new adsr_widget(gen));
+			generator_table->setCellWidget(row, col++, new filter_widget(gen));
+			generator_table->setItem(row, col++, new QTableWidgetItem(QString(gen->t.name.c_str())));
+			generator_table->setCellWidget(row, col++, new keyboard_channel_widget(gen));
+			generator_table->setCellWidget(row, col++, new velocity_widget(gen));
+			generator_table->setCellWidget(row, col++, new sample_range_widget(gen));
+			generator_table->setItem(row, col++, new QTableWidgetItem(QString(gen->t.sample_->t.file_name.c_str())));
+
+			QTableWidgetItem *cpu = new QTableWidgetItem("-");
+			cpu->setFlags(Qt::ItemIsEnabled);
+			generator_table->setItem(row, col++, cpu);
+		}
+
+		/**
+			Show the share of the time each generator's voices took to render
+			since the last call, and append it to the stats file. The total of the
+			process callback goes to the column header.
+		*/
+		void update_cpu_stats() {
+			const uint64_t now = trace::now();
+			const double elapsed = (double)(now - last_cpu_stats_ticks);
+			last_cpu_stats_ticks = now;
+			if (elapsed <= 0) return;
+
+			const double ns_per_tick = 1.0 / engine_.cpu_stats_.ticks_per_ns();
+			const long seconds = (long)time(0);
+
+			std::map<unsigned int, cpu_sample> samples;
+			for (unsigned int row = 0; row < engine_.gens->t.size(); ++row) {
+				const generator &g = engine_.gens->t[row]->t;
+				const cpu_sample s = { g.cpu.ticks, g.cpu.voice_frames };
+				samples[g.id] = s;
+
+				std::map<unsigned int, cpu_sample>::const_iterator last = last_cpu_samples.find(g.id);
+				if (last == last_cpu_samples.end()) continue;
+
+				//! Counters which went backwards start over
+				const double ticks = s.ticks >= last->second.ticks ? (double)(s.ticks - last->second.ticks) : 0;
+				const double frames = s.voice_frames >= last->second.voice_frames ? (double)(s.voice_frames - last->second.voice_frames) : 0;
+
+				const double percent = 100.0 * ticks / elapsed;
+				const double ns_per_voice_frame = frames > 0 ? ticks * ns_per_tick / frames : 0;
+
+				QTableWidgetItem *item = generator_table->item(row, CPU_COLUMN);
+				if (item) {
+					item->setText(QString::number(percent, 'f', 1));
+					item->setToolTip(QString("%1 ns per voice and frame").arg(ns_per_voice_frame, 0, 'f', 1));
+				}
+
+				if (stats_file.is_open()) stats_file << seconds << ",\"" << g.name << "\"," << percent << "," << ns_per_voice_frame << "\n";
+			}
+			last_cpu_samples.swap(samples);
+
+			const cpu_sample process = { engine_.cpu_stats_.process.ticks, engine_.cpu_stats_.process.voice_frames };
+			const double process_percent = 100.0 * (double)(process.ticks - last_process_cpu_sample.ticks) / elapsed;
+			last_process_cpu_sample = process;
+
+			generator_table->horizontalHeaderItem(CPU_COLUMN)->setText(QString("CPU % (total %1)").arg(process_percent, 0, 'f', 1));
+			if (stats_file.is_open()) stats_file << seconds << ",total," << process_percent << ",0" << std::endl;
+		}
+
+		//! Returns the row of the generator with the given id in the generator table or -1
+		int generator_row(unsigned int id) {
+			for (unsigned int row = 0; row < engine_.gens->t.size(); ++row) {
+				if (engine_.gens->t[row]->t.id == id) return row;
+			}
+			return -1;
+		}
+
+		/**
+			Move the dial of parameter in row to value. The widgets stay in place:
+			recreating them would destroy a dial the user is dragging and leave
+			their deferred update() calls with deleted widgets
+		*/
+		void show_generator_parameter(int row, int parameter, double value) {
+			if (adsr_widget *w = qobject_cast<adsr_widget*>(generator_table->cellWidget(row, ADSR_COLUMN))) w->show_parameter(parameter, value);
+			if (filter_widget *w = qobject_cast<filter_widget*>(generator_table->cellWidget(row, FILTER_COLUMN))) w->show_parameter(parameter, value);
+			if (keyboard_channel_widget *w = qobject_cast<keyboard_channel_widget*>(generator_table->cellWidget(row, KEYBOARD_CHANNEL_COLUMN))) w->show_parameter(parameter, value);
+			if (velocity_widget *w = qobject_cast<velocity_widget*>(generator_table->cellWidget(row, VELOCITY_COLUMN))) w->show_parameter(parameter, value);
+		}
+
+		//! Called when the engine signals controller_feedback_
+		void drain_controller_feedback() {
+			engine_.controller_feedback_.drain(boost::bind(&main_window::controller_feedback_record, this, _1));
+		}
+
+		void controller_feedback_record(const controller_feedback::record &r) {
+			const int row = generator_row(r.generator_id);
+			if (row < 0) return;
+
+			if (r.kind == controller_feedback::PARAMETER_CHANGED) {
+				//! The engine already changed the parameter, the widgets just need to show it
+				show_generator_parameter(row, r.parameter, r.value);
+				return;
+			}
+
+			double min, max;
+			int curve;
+			controller_parameter_defaults(r.parameter, min, max, curve);
+
+			disposable_controller_map_ptr m = disposable_controller_map::create(controller_mapping_vector());
+			for (unsigned int index = 0; index < engine_.controller_map->t.size(); ++index) {
+				const controller_mapping &c = engine_.controller_map->t[index];
+				if (c.channel == r.channel && c.controller == r.controller) continue;
+				m->t.push_back(c);
+			}
+			m->t.push_back(controller_mapping(r.channel, r.controller, engine_.gens->t[row], r.parameter, min, max, curve));
+
+			engine_.write_command(boost::bind(&engine::set_controller_map, boost::ref(engine_), m));
+			log_text_edit->append(
+				QString("Mapped controller %1 on channel %2 to %3 of %4")
+					.arg(r.controller)
+					.arg(r.channel)
+					.arg(controller_parameter_names[r.parameter])
+					.arg(engine_.gens->t[row]->t.name.c_str())
+			);
+		}
 	
 		void load_setup(const std::string &file_name) {
 			if (getenv("LADISH_APP_NAME") != 0) {
@@ -252,23 +497,29 @@ class main_window : public QMainWindow {
 			}
 			try {
 				//! First try loading all generators
-				disposable_generator_list_ptr l = 
-					disposable_generator_list::create(
-						generator_list());
+				disposable_generator_vector_ptr l = 
+					disposable_generator_vector::create(
+						generator_vector());
 
 				xsd_error_handler h;
 				std::auto_ptr<Jass::Jass> j = Jass::Jass_(file_name, h, xml_schema::flags::dont_validate);
 				Jass::Jass jass_ = *j;
 				Jass::Jass_(std::cout, jass_);
+
+				log_memory_estimate(jass_);
+
+				//! Generators playing the same file share the sample
+				std::map<std::string, disposable_sample_ptr> loaded_samples;
+
  				int i = 0;
 				for(Jass::Jass::Generator_const_iterator it = jass_.Generator().begin(); it != jass_.Generator().end(); ++it) {
-					log_text_edit->append(QString("Loading sample: %1").arg((*it).Sample().c_str()));
-					disposable_generator_ptr p = disposable_generator::create(
-						generator(
-							(*it).Name(),
-							disposable_sample::create(sample((*it).Sample(), jack_get_sample_rate(engine_.jack_client)))
-						)
-					);
+					disposable_sample_ptr s = loaded_samples[(*it).Sample()];
+					if (!s) {
+						log_text_edit->append(QString("Loading sample: %1").arg((*it).Sample().c_str()));
+						s = loaded_samples[(*it).Sample()] = disposable_sample::create(sample((*it).Sample(), jack_get_sample_rate(engine_.jack_client)));
+					}
+
+					disposable_generator_ptr p = disposable_generator::create(generator((*it).Name(), s));
 					if ((*it).SampleStart()) p->t.sample_start = *(*it).SampleStart();
 					if ((*it).SampleEnd()) p->t.sample_end = *(*it).SampleEnd();
 					if ((*it).Looping()) p->t.looping = *(*it).Looping();
@@ -287,20 +538,68 @@ class main_window : public QMainWindow {
 					if ((*it).DecayGain()) p->t.decay_g = *(*it).DecayGain();
 					if ((*it).SustainGain()) p->t.sustain_g = *(*it).SustainGain();
 					if ((*it).ReleaseGain()) p->t.release_g = *(*it).ReleaseGain();
+					if ((*it).MaxVoices()) p->t.max_voices = *(*it).MaxVoices();
+					if ((*it).ChokeGroup()) p->t.choke_group = *(*it).ChokeGroup();
+					if ((*it).Retrigger()) p->t.retrigger = *(*it).Retrigger();
+					if ((*it).Tune()) p->t.tune = *(*it).Tune();
+					if ((*it).FilterType()) {
+						for (int type = 0; type < NUMBER_OF_FILTER_TYPES; ++type) {
+							if (std::string(*(*it).FilterType()) == filter_type_names[type]) p->t.filter_type = type;
+						}
+					}
+					if ((*it).FilterCutoff()) p->t.filter_cutoff = *(*it).FilterCutoff();
+					if ((*it).FilterQ()) p->t.filter_q = *(*it).FilterQ();
+					if ((*it).FilterVelocityAmount()) p->t.filter_velocity_amount = *(*it).FilterVelocityAmount();
+					if ((*it).FilterEnvelopeAmount()) p->t.filter_envelope_amount = *(*it).FilterEnvelopeAmount();
+					if ((*it).Interpolation()) {
+						const int interpolation = interpolation_of_name(std::string(*(*it).Interpolation()));
+						if (interpolation >= 0) p->t.interpolation = interpolation;
+					}
+					p->t.update();
 
 					l->t.push_back(p);
 					log_text_edit->append(QString("Done loading sample: %1").arg((*it).Sample().c_str()));
 					QApplication::processEvents();
 				}
 
+				disposable_controller_map_ptr m = disposable_controller_map::create(controller_mapping_vector());
+				for (Jass::Jass::ControllerMapping_const_iterator it = jass_.ControllerMapping().begin(); it != jass_.ControllerMapping().end(); ++it) {
+					if ((*it).Generator() >= l->t.size()) continue;
+
+					int parameter = -1;
+					for (int index = 0; index < NUMBER_OF_CONTROLLER_PARAMETERS; ++index) {
+						if (std::string((*it).Parameter()) == controller_parameter_names[index]) parameter = index;
+					}
+					if (parameter < 0) continue;
+
+					int curve = CURVE_LINEAR;
+					if ((*it).Curve() && std::string(*(*it).Curve()) == controller_curve_names[CURVE_EXPONENTIAL]) curve = CURVE_EXPONENTIAL;
+
+					m->t.push_back(controller_mapping((*it).Channel(), (*it).Controller(), l->t[(*it).Generator()], parameter, (*it).Min(), (*it).Max(), curve));
+				}
+
+				engine::voice_stealing_policy voice_stealing = engine::STEAL_OLDEST;
+				if (jass_.VoiceStealing()) {
+					const std::string policy = *jass_.VoiceStealing();
+					if (policy == "quietest") voice_stealing = engine::STEAL_QUIETEST;
+					if (policy == "releasing-first") voice_stealing = engine::STEAL_RELEASING_FIRST;
+				}
+
 				setup_file_name = file_name;
 
 				setEnabled(false);
 					engine_.write_command(assign(engine_.gens, l));
-					disposable_gvoice_vector_ptr voices(disposable_gvoice_vector::create(std::vector<gvoice>(jass_.Polyphony())));
-					engine_.write_command(assign(engine_.voices, voices));
-				engine_.deferred_commands.write(boost::bind(&main_window::update_generator_table, this));
-				engine_.deferred_commands.write(boost::bind(&main_window::setEnabled, this, true));
+					disposable_voice_pool_ptr voices(engine::create_voices(jass_.Polyphony()));
+					engine_.write_command(boost::bind(&engine::set_voices, boost::ref(engine_), voices, (unsigned int)jass_.Polyphony()));
+					engine_.write_command(assign(engine_.voice_stealing, voice_stealing));
+					if (jass_.SilenceThreshold()) engine_.write_command(assign(engine_.silence_threshold, pow(10.0, *jass_.SilenceThreshold()/20.0)));
+					if (jass_.PitchBendRange()) engine_.write_command(assign(engine_.pitch_bend_range, (unsigned int)*jass_.PitchBendRange()));
+					mipmap_octaves = jass_.MipmapOctaves() ? (unsigned int)*jass_.MipmapOctaves() : 0;
+					engine_.write_command(boost::bind(&engine::set_controller_map, boost::ref(engine_), m));
+				engine_.defer(boost::bind(&main_window::update_generator_table, this));
+				engine_.defer(boost::bind(&main_window::log_memory_report, this));
+				engine_.defer(boost::bind(&main_window::build_mipmaps, this));
+				engine_.defer(boost::bind(&main_window::setEnabled, this, true));
 				//! Then write them in one go, replacing the whole gens collection
 			} catch(...) {
 				log_text_edit->append(("something went wrong loading file: " + file_name + ". Try fixing your filesystem mounts, etc, then try reloading the setup").c_str());
@@ -318,17 +617,86 @@ class main_window : public QMainWindow {
 		void remove_generator() {
 			if (generator_table->currentRow() >= 0 && generator_table->currentRow() < generator_table->rowCount()) {
 				// std::cout << "current row: " << generator_table->currentRow() << std::endl;
-				disposable_generator_list_ptr l = disposable_generator_list::create(engine_.gens->t);
-				generator_list::iterator it = l->t.begin();
+				disposable_generator_vector_ptr l = disposable_generator_vector::create(engine_.gens->t);
+				generator_vector::iterator it = l->t.begin();
 				std::advance(it, generator_table->currentRow());
+				const generator *removed = &(*it)->t;
 				l->t.erase(it);
+
+				//! Mappings keep their generator alive, so drop those of the removed one
+				disposable_controller_map_ptr m = disposable_controller_map::create(controller_mapping_vector());
+				for (unsigned int index = 0; index < engine_.controller_map->t.size(); ++index) {
+					if (&engine_.controller_map->t[index].gen->t != removed) m->t.push_back(engine_.controller_map->t[index]);
+				}
+
 				setEnabled(false);
 					engine_.write_command(assign(engine_.gens, l));
-					engine_.deferred_commands.write(boost::bind(&main_window::update_generator_table, this));
-				engine_.deferred_commands.write(boost::bind(&main_window::setEnabled, this, true));
+					engine_.write_command(boost::bind(&engine::set_controller_map, boost::ref(engine_), m));
+					engine_.defer(boost::bind(&main_window::update_generator_table, this));
+				engine_.defer(boost::bind(&main_window::setEnabled, this, true));
 			}
 		}
 
+		//! Append memory_report() to the log
+		void log_memory_report() {
+			std::stringstream report;
+			memory_report(report, engine_);
+
+			log_text_edit->append("Memory:");
+			std::string line;
+			while (std::getline(report, line)) log_text_edit->append(line.c_str());
+		}
+
+		//! Log whether the samples of a setup will fit into memory, judging by their sound file headers
+		void log_memory_estimate(const Jass::Jass &jass_) {
+			std::map<std::string, bool> seen;
+			size_t resident = 0, transient = 0;
+			unsigned int unreadable = 0;
+
+			for (Jass::Jass::Generator_const_iterator it = jass_.Generator().begin(); it != jass_.Generator().end(); ++it) {
+				if (seen[(*it).Sample()]) continue;
+				seen[(*it).Sample()] = true;
+
+				size_t sample_resident, sample_transient;
+				if (!estimate_sample_memory((*it).Sample(), jack_get_sample_rate(engine_.jack_client), sample_resident, sample_transient)) {
+					++unreadable;
+					continue;
+				}
+
+				resident += sample_resident;
+				//! One sample is loaded at a time
+				transient = std::max(transient, sample_transient);
+			}
+
+			const size_t available = available_memory();
+			log_text_edit->append(
+				QString("Estimated sample memory: %1 (%2 more while loading), available: %3")
+					.arg(format_bytes(resident).c_str()).arg(format_bytes(transient).c_str()).arg(format_bytes(available).c_str())
+			);
+			if (unreadable > 0) log_text_edit->append(QString("Couldn't read the headers of %1 sample files").arg(unreadable));
+			if (resident + transient > available) log_text_edit->append("The samples might not fit into memory");
+		}
+
+		//! Write the events recorded by engine::trace_ to a Chrome trace JSON file in /tmp
+		void dump_trace() {
+#ifndef JASS_TRACE
+			log_text_edit->append("This jass was built without tracing. Rebuild with -DJASS_TRACE=1 and start it with --trace");
+#else
+			if (!engine_.trace_.enabled) {
+				log_text_edit->append("Tracing is not enabled. Start jass with --trace");
+				return;
+			}
+
+			char file_name[256];
+			snprintf(file_name, sizeof(file_name), "/tmp/jass-trace-%d-%ld.json", (int)getpid(), (long)time(0));
+			if (engine_.trace_.dump(file_name)) {
+				log_text_edit->append(QString("Wrote trace: %1").arg(file_name));
+			} else {
+				log_text_edit->append(QString("something went wrong writing the trace: %1").arg(file_name));
+			}
+#endif
+		}
+
 		void show_about_text() {
 			log_text_edit->append("-------------------");
 			log_text_edit->append("This is jass - Jack Simple Sampler");
@@ -346,21 +714,25 @@ class main_window : public QMainWindow {
 		}
 
 		void show_keyboard(bool show) {
-			generator_table->setColumnHidden(3, !show);
+			generator_table->setColumnHidden(4, !show);
 
 		}
 
 
 		void show_waveform(bool show) {
-			generator_table->setColumnHidden(5, !show);
+			generator_table->setColumnHidden(6, !show);
 
 		}
 
 	public:
 
 		main_window(engine &e) :
-			engine_(e)
+			engine_(e),
+			mipmap_octaves(0),
+			last_cpu_stats_ticks(trace::now())
 		{
+			last_process_cpu_sample.ticks = last_process_cpu_sample.voice_frames = 0;
+
 			setWindowTitle("jass - jack simple sampler");
 
 			generator_table = new QTableWidget();
@@ -368,17 +740,29 @@ class main_window : public QMainWindow {
 			headers 
 				<< "Mute"
 				<< "Gain/ADSR"
+				<< "Filter"
 				<< "Name"
 				<< "Note-Range"
 				<< "Velocity Factor/Range"
 				<< "Waveform/Looping/Ranges"
-				<< "Sample";
+				<< "Sample"
+				<< "CPU %";
 
 			generator_table->setColumnCount(headers.size());
 			generator_table->setHorizontalHeaderLabels(headers);
 			generator_table->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel); 
 			generator_table->setHorizontalScrollMode(QAbstractItemView::ScrollPerPixel); 
 			connect(generator_table, SIGNAL(itemChanged(QTableWidgetItem*)), this, SLOT(generator_item_changed(QTableWidgetItem*)));
+			generator_table->horizontalHeaderItem(CPU_COLUMN)->setToolTip("The share of the time spent rendering the generator's voices. Hover over a cell for the cost per voice");
+
+			cpu_stats_timer = new QTimer(this);
+			cpu_stats_timer->setInterval(1000);
+			connect(cpu_stats_timer, SIGNAL(timeout()), this, SLOT(update_cpu_stats()));
+#ifdef JASS_CPU_STATS
+			cpu_stats_timer->start();
+#else
+			generator_table->setColumnHidden(CPU_COLUMN, true);
+#endif
 			setCentralWidget(generator_table);
 
 			file_dialog_dock_widget = new QDockWidget();
@@ -449,6 +833,9 @@ class main_window : public QMainWindow {
 				menu_bar->addMenu(help_menu);
 					connect(help_menu->addAction("&Help in Log"), SIGNAL(triggered(bool)), this, SLOT(show_help_text()));
 					connect(help_menu->addAction("&About"), SIGNAL(triggered(bool)), this, SLOT(show_about_text()));
+					help_menu->addSeparator();
+					connect(help_menu->addAction("Dump Engine &Trace"), SIGNAL(triggered(bool)), this, SLOT(dump_trace()));
+					connect(help_menu->addAction("&Memory Report"), SIGNAL(triggered(bool)), this, SLOT(log_memory_report()));
 	
 			setMenuBar(menu_bar);
 
@@ -0,0 +1,141 @@
+#ifndef JASS_MEMORY_REPORT_HH
+#define JASS_MEMORY_REPORT_HH
+
+#include <map>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <cmath>
+
+#include <unistd.h>
+
+#include <sndfile.h>
+
+#include "engine_core.h"
+#include "memory_usage.h"
+
+template <class T>
+inline size_t ringbuffer_memory(const ringbuffer<T> &r) {
+	return vector_memory(r.elements) + r.jack_ringbuffer->size;
+}
+
+inline std::string format_bytes(double bytes) {
+	std::stringstream s;
+	s << std::fixed << std::setprecision(1);
+	if (bytes >= 1024.0 * 1024.0) s << bytes / (1024.0 * 1024.0) << " MB";
+	else if (bytes >= 1024.0) s << bytes / 1024.0 << " KB";
+	else s << std::setprecision(0) << bytes << " B";
+	return s.str();
+}
+
+/**
+	Write where the memory of engine e goes: the samples (split into the ones
+	used by a single generator and the ones shared), the generators, the voice
+	pool, the queues and the disposables waiting for heap::cleanup(). Call this
+	in the GUI thread.
+*/
+inline void memory_report(std::ostream &o, const engine_core &e) {
+	const generator_vector &gens = e.gens->t;
+
+	//! The samples in the order of their first generator and the number of generators using each
+	std::vector<disposable_sample_ptr> samples;
+	std::map<const disposable_sample *, unsigned int> users;
+	std::map<const disposable_mipmaps *, size_t> mipmaps;
+	size_t generator_bytes = 0;
+	for (generator_vector::const_iterator it = gens.begin(); it != gens.end(); ++it) {
+		generator_bytes += (*it)->memory();
+		if (users[(*it)->t.sample_.get()]++ == 0) samples.push_back((*it)->t.sample_);
+		if ((*it)->t.mipmaps_) mipmaps[(*it)->t.mipmaps_.get()] = (*it)->t.mipmaps_->memory();
+	}
+
+	size_t mipmap_bytes = 0;
+	for (std::map<const disposable_mipmaps *, size_t>::const_iterator it = mipmaps.begin(); it != mipmaps.end(); ++it) {
+		mipmap_bytes += it->second;
+	}
+
+	size_t unique_bytes = 0, shared_bytes = 0;
+	unsigned int unique_count = 0, shared_count = 0;
+	for (std::vector<disposable_sample_ptr>::const_iterator it = samples.begin(); it != samples.end(); ++it) {
+		const size_t bytes = (*it)->memory();
+		const unsigned int count = users[it->get()];
+
+		if (count > 1) {
+			shared_bytes += bytes;
+			++shared_count;
+		} else {
+			unique_bytes += bytes;
+			++unique_count;
+		}
+
+		o
+			<< "  " << (*it)->t.file_name << ": " << format_bytes(bytes)
+			<< " (" << (*it)->t.frames << " frames, " << (*it)->t.channels << " channels), used by " << count << " generator" << (count > 1 ? "s" : "")
+			<< std::endl;
+	}
+
+	o
+		<< "Samples: " << samples.size() << ", " << format_bytes(unique_bytes + shared_bytes)
+		<< " (" << unique_count << " unique: " << format_bytes(unique_bytes) << ", " << shared_count << " shared: " << format_bytes(shared_bytes) << ")"
+		<< std::endl;
+
+	o << "Mipmaps: " << mipmaps.size() << " samples, " << format_bytes(mipmap_bytes) << std::endl;
+	o << "Generators: " << gens.size() << ", " << format_bytes(generator_bytes + e.gens->memory()) << std::endl;
+	o << "Voice pool: " << e.voices->t.voices.size() << " voices, " << format_bytes(e.voices->memory()) << std::endl;
+	o << "Prerender: " << e.prerender_.slots.size() << " slots, " << format_bytes(e.prerender_.memory()) << std::endl;
+	o << "Controller map: " << e.controller_map->t.size() << " mappings, " << format_bytes(e.controller_map->memory()) << std::endl;
+
+	const size_t queue_bytes =
+		ringbuffer_memory(e.commands) + ringbuffer_memory(e.acknowledgements) + ringbuffer_memory(e.deferred_commands)
+		+ e.log_.jack_ringbuffer->size + e.controller_feedback_.jack_ringbuffer->size;
+	o << "Queues: " << format_bytes(queue_bytes) << std::endl;
+	o << "Trace: " << format_bytes(vector_memory(e.trace_.events)) << std::endl;
+
+	size_t referenced, backlog;
+	unsigned int backlog_objects;
+	heap::get()->memory(referenced, backlog, backlog_objects);
+	o << "Heap: " << format_bytes(referenced) << " referenced, reclaim backlog: " << backlog_objects << " objects, " << format_bytes(backlog) << std::endl;
+}
+
+/**
+	What loading the sound file file_name at rate will take, judging by its
+	header alone: resident is what the sample keeps, transient what the loader
+	needs on top while loading it. Returns false if the file can not be read.
+*/
+inline bool estimate_sample_memory(const std::string &file_name, jack_nframes_t rate, size_t &resident, size_t &transient) {
+	SF_INFO sf_info;
+	sf_info.format = 0;
+	SNDFILE *snd_file = sf_open(file_name.c_str(), SFM_READ, &sf_info);
+	if (snd_file == 0) return false;
+	sf_close(snd_file);
+
+	if ((sf_info.channels != 1 && sf_info.channels != 2) || sf_info.samplerate <= 0) return false;
+
+	const double frames = ceil((double)sf_info.frames * rate / sf_info.samplerate);
+
+	resident =
+		sizeof(disposable_sample) + file_name.size()
+		+ (size_t)(frames + 2 * sample::padding) * sf_info.channels * sizeof(float)
+		+ (size_t)(frames / sample::peak_segment_frames + 1) * sizeof(float);
+
+	//! The frames read from the file and the resampled ones
+	transient = (size_t)(sf_info.frames + frames) * sf_info.channels * sizeof(float);
+	return true;
+}
+
+//! The memory available without swapping, according to the kernel
+inline size_t available_memory() {
+	std::ifstream meminfo("/proc/meminfo");
+	std::string key, unit;
+	size_t kilobytes;
+	while (meminfo >> key >> kilobytes) {
+		std::getline(meminfo, unit);
+		if (key == "MemAvailable:") return kilobytes * 1024;
+	}
+
+	return (size_t)sysconf(_SC_AVPHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef JASS_MEMORY_USAGE_HH
+#define JASS_MEMORY_USAGE_HH
+
+#include <cstddef>
+#include <vector>
+#include <string>
+
+//! The bytes a vector holds on the heap, not counting the vector itself
+template <class T>
+inline size_t vector_memory(const std::vector<T> &v) {
+	return v.capacity() * sizeof(T);
+}
+
+inline size_t string_memory(const std::string &s) {
+	return s.capacity();
+}
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef JASS_MIPMAP_HH
+#define JASS_MIPMAP_HH
+
+#include <vector>
+#include <deque>
+#include <cmath>
+#include <algorithm>
+
+#include <pthread.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include "sample.h"
+#include "disposable.h"
+#include "event_fd.h"
+#include "memory_usage.h"
+
+//! A copy of a sample at half the rate of the level below, laid out like sample (padding included)
+struct mipmap_level {
+	std::vector<float> data_0;
+	std::vector<float> data_1;
+	unsigned int frames;
+
+	mipmap_level() : frames(0) { }
+
+	inline const float *begin_0() const { return &data_0[sample::padding]; }
+	inline const float *begin_1() const { return data_1.empty() ? 0 : &data_1[sample::padding]; }
+};
+
+/**
+	Band-limited, decimated copies of a sample: levels[n] is n + 1 octaves
+	down, i.e. has a 2^(n + 1)th of the frames. A voice transposed up by k
+	octaves or more reads level k (see generator::render()), so it steps
+	through less than two frames per output frame however far it is
+	transposed, and reads no content it would alias.
+
+	These are built outside the process thread, see mipmap_builder.
+*/
+struct sample_mipmaps {
+	std::vector<mipmap_level> levels;
+
+	//! The taps of the half band low pass used for decimating
+	enum { filter_taps = 63 };
+
+	//! Build octaves levels from s. This takes a while, do not call it in the process thread
+	void build(const sample &s, unsigned int octaves) {
+		std::vector<float> h(filter_taps);
+		const double half = (filter_taps - 1) / 2.0;
+		double sum = 0;
+		for (unsigned int tap = 0; tap < filter_taps; ++tap) {
+			const double x = tap - half;
+
+			//! The cutoff is just below the new Nyquist, a quarter of the old rate
+			const double cutoff = 0.45;
+			const double sinc = (x == 0) ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+			const double w = 0.42 + 0.5 * cos(M_PI * x / (half + 1)) + 0.08 * cos(2.0 * M_PI * x / (half + 1));
+			h[tap] = (float)(sinc * w);
+			sum += sinc * w;
+		}
+		for (unsigned int tap = 0; tap < filter_taps; ++tap) h[tap] /= (float)sum;
+
+		levels.assign(octaves, mipmap_level());
+
+		const float *in_0 = s.begin_0();
+		const float *in_1 = s.begin_1();
+		unsigned int in_frames = s.frames;
+
+		for (unsigned int level = 0; level < octaves; ++level) {
+			mipmap_level &l = levels[level];
+			l.frames = (in_frames + 1) / 2;
+			l.data_0.assign(l.frames + 2 * sample::padding, 0);
+			decimate(h, in_0, in_frames, &l.data_0[sample::padding], l.frames);
+			if (in_1) {
+				l.data_1.assign(l.frames + 2 * sample::padding, 0);
+				decimate(h, in_1, in_frames, &l.data_1[sample::padding], l.frames);
+			}
+
+			in_0 = l.begin_0();
+			in_1 = l.begin_1();
+			in_frames = l.frames;
+		}
+	}
+
+	protected:
+		//! Low pass in (frames long, zero outside) with h and keep every second frame
+		static void decimate(const std::vector<float> &h, const float *in, unsigned int frames, float *out, unsigned int out_frames) {
+			const int half = (int)h.size() / 2;
+			for (unsigned int frame = 0; frame < out_frames; ++frame) {
+				const int center = 2 * (int)frame;
+				const int first = std::max(0, half - center);
+				const int last = std::min((int)h.size(), (int)frames - center + half);
+
+				float sum = 0;
+				for (int tap = first; tap < last; ++tap) sum += h[tap] * in[center + tap - half];
+				out[frame] = sum;
+			}
+		}
+};
+
+inline size_t disposable_memory(const sample_mipmaps &m) {
+	size_t bytes = sizeof(sample_mipmaps) + vector_memory(m.levels);
+	for (unsigned int level = 0; level < m.levels.size(); ++level) {
+		bytes += vector_memory(m.levels[level].data_0) + vector_memory(m.levels[level].data_1);
+	}
+	return bytes;
+}
+
+typedef disposable<sample_mipmaps> disposable_mipmaps;
+typedef boost::shared_ptr<disposable_mipmaps> disposable_mipmaps_ptr;
+
+/**
+	Builds sample_mipmaps in a thread of its own. The GUI thread creates the
+	(empty) disposables and queues them with add(). The worker builds the
+	levels into sample_mipmaps of its own and never touches the disposables,
+	which the GUI thread may read at any time (e.g. for heap::memory()). Once
+	done is signalled the GUI thread moves the levels into the disposables with
+	take_finished() and hands them to the generators through commands.
+*/
+struct mipmap_builder {
+	struct job {
+		disposable_sample_ptr source;
+		disposable_mipmaps_ptr mipmaps;
+		unsigned int octaves;
+	};
+
+	//! Signalled whenever a job is finished
+	event_fd done;
+
+	mipmap_builder() :
+		quit(false)
+	{
+		pthread_mutex_init(&mutex, 0);
+		pthread_cond_init(&condition, 0);
+		pthread_create(&thread, 0, &mipmap_builder::run_thread, this);
+	}
+
+	~mipmap_builder() {
+		pthread_mutex_lock(&mutex);
+		quit = true;
+		pthread_cond_signal(&condition);
+		pthread_mutex_unlock(&mutex);
+
+		pthread_join(thread, 0);
+		pthread_cond_destroy(&condition);
+		pthread_mutex_destroy(&mutex);
+	}
+
+	//! Only call this in the GUI thread
+	void add(disposable_sample_ptr source, disposable_mipmaps_ptr mipmaps, unsigned int octaves) {
+		job j;
+		j.source = source;
+		j.mipmaps = mipmaps;
+		j.octaves = octaves;
+
+		pending.push_back(j);
+
+		const work w = { &source->t, &mipmaps->t, octaves };
+		pthread_mutex_lock(&mutex);
+		queued.push_back(w);
+		pthread_cond_signal(&condition);
+		pthread_mutex_unlock(&mutex);
+	}
+
+	//! Whether mipmaps of s are being built. Only call this in the GUI thread
+	bool building(const disposable_sample_ptr &s) {
+		for (unsigned int index = 0; index < pending.size(); ++index) {
+			if (pending[index].source == s) return true;
+		}
+		return false;
+	}
+
+	//! Only call this in the GUI thread. Returns the jobs finished since the last call
+	std::vector<job> take_finished() {
+		done.drain();
+
+		std::deque<result> built;
+		pthread_mutex_lock(&mutex);
+		built.swap(finished);
+		pthread_mutex_unlock(&mutex);
+
+		//! The disposables stay referenced in pending until they are handed out, so the heap keeps them
+		std::vector<job> jobs;
+		for (unsigned int index = 0; index < built.size(); ++index) {
+			for (unsigned int p = 0; p < pending.size(); ++p) {
+				if (&pending[p].mipmaps->t == built[index].target) {
+					pending[p].mipmaps->t.levels.swap(built[index].mipmaps.levels);
+					jobs.push_back(pending[p]);
+					pending.erase(pending.begin() + p);
+					break;
+				}
+			}
+		}
+		return jobs;
+	}
+
+	protected:
+		pthread_t thread;
+		pthread_mutex_t mutex;
+		pthread_cond_t condition;
+		bool quit;
+
+		//! The worker only gets raw pointers, the shared_ptrs stay in the GUI thread. It never dereferences target
+		struct work {
+			const sample *source;
+			const sample_mipmaps *target;
+			unsigned int octaves;
+		};
+
+		//! Levels built by the worker for target, moved there in take_finished()
+		struct result {
+			const sample_mipmaps *target;
+			sample_mipmaps mipmaps;
+		};
+
+		//! Guarded by mutex
+		std::deque<work> queued;
+		std::deque<result> finished;
+
+		//! Only used in the GUI thread
+		std::vector<job> pending;
+
+		void run() {
+			pthread_mutex_lock(&mutex);
+			while (true) {
+				while (!quit && queued.empty()) pthread_cond_wait(&condition, &mutex);
+				if (quit) break;
+
+				const work w = queued.front();
+				queued.pop_front();
+				pthread_mutex_unlock(&mutex);
+
+				sample_mipmaps m;
+				m.build(*w.source, w.octaves);
+
+				pthread_mutex_lock(&mutex);
+				finished.push_back(result());
+				finished.back().target = w.target;
+				finished.back().mipmaps.levels.swap(m.levels);
+				done.signal();
+			}
+			pthread_mutex_unlock(&mutex);
+		}
+
+		static void *run_thread(void *arg) {
+			((mipmap_builder*)arg)->run();
+			return 0;
+		}
+
+	private:
+		mipmap_builder(const mipmap_builder&);
+		mipmap_builder &operator=(const mipmap_builder&);
+};
+
+#endif
@@ -17,7 +17,7 @@ struct mute_widget : public QWidget {
 
 	public slots:
 		void checked(bool checked) {
-			engine::get()->write_command(assign(gen->t.muted, checked));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.muted, checked));
 		}
 
 	public:
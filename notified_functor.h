@@ -0,0 +1,23 @@
+#ifndef JASS_NOTIFIED_FUNCTOR_HH
+#define JASS_NOTIFIED_FUNCTOR_HH
+
+#include <QSocketNotifier>
+
+#include <boost/function.hpp>
+
+#include "qfunctor.h"
+
+//! Calls the functor from the Qt event loop whenever fd becomes readable. The functor has to drain fd.
+struct notified_functor {
+	qfunctor qf;
+	QSocketNotifier notifier;
+	notified_functor(boost::function<void(void)> t, int fd) 
+	: 
+		qf(t),
+		notifier(fd, QSocketNotifier::Read)
+	{
+		notifier.connect(&notifier, SIGNAL(activated(int)), &qf, SLOT(exec()));
+	}
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef JASS_POOL_ALLOCATOR_HH
+#define JASS_POOL_ALLOCATOR_HH
+
+#include <cstddef>
+#include <new>
+
+/**
+	A pool of fixed size blocks. Blocks are carved out of larger chunks
+	and freed blocks are kept on a free list for reuse. Chunks are never
+	returned to the system, the pool lives as long as the process does.
+
+	Note that this is not thread safe. All disposables are created and
+	destroyed in the GUI thread (see heap::cleanup()), so this is fine for
+	the intended use.
+*/
+template <std::size_t BlockSize>
+struct block_pool {
+	union block {
+		block *next;
+		char storage[BlockSize];
+
+		//! These are only here to get the strictest alignment
+		long double ld;
+		void *p;
+	};
+
+	//! Number of blocks allocated in one go when the free list runs dry
+	enum { blocks_per_chunk = 64 };
+
+	block *free_list;
+
+	static block_pool &get() {
+		static block_pool p;
+		return p;
+	}
+
+	void *allocate() {
+		if (0 == free_list) grow();
+
+		block *b = free_list;
+		free_list = b->next;
+		return b;
+	}
+
+	void deallocate(void *p) {
+		block *b = static_cast<block*>(p);
+		b->next = free_list;
+		free_list = b;
+	}
+
+	protected:
+		block_pool() : free_list(0) { }
+
+		void grow() {
+			block *chunk = static_cast<block*>(::operator new(sizeof(block) * blocks_per_chunk));
+			for (unsigned int index = 0; index < blocks_per_chunk; ++index) {
+				deallocate(chunk + index);
+			}
+		}
+};
+
+/**
+	A standard allocator handing out single objects from a block_pool
+	of matching size. Requests for more than one object at a time (which
+	node based users like boost::allocate_shared never make) fall back to
+	operator new.
+*/
+template <class T>
+struct pool_allocator {
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+
+	template <class U>
+	struct rebind {
+		typedef pool_allocator<U> other;
+	};
+
+	pool_allocator() { }
+
+	template <class U>
+	pool_allocator(const pool_allocator<U> &) { }
+
+	pointer address(reference r) const { return &r; }
+	const_pointer address(const_reference r) const { return &r; }
+
+	pointer allocate(size_type n, const void * = 0) {
+		if (n == 1) return static_cast<pointer>(block_pool<sizeof(T)>::get().allocate());
+		return static_cast<pointer>(::operator new(n * sizeof(T)));
+	}
+
+	void deallocate(pointer p, size_type n) {
+		if (n == 1) block_pool<sizeof(T)>::get().deallocate(p);
+		else ::operator delete(p);
+	}
+
+	size_type max_size() const { return std::size_t(-1) / sizeof(T); }
+
+	void construct(pointer p, const T &t) { new (p) T(t); }
+	void destroy(pointer p) { p->~T(); }
+};
+
+template <class T, class U>
+inline bool operator==(const pool_allocator<T> &, const pool_allocator<U> &) { return true; }
+
+template <class T, class U>
+inline bool operator!=(const pool_allocator<T> &, const pool_allocator<U> &) { return false; }
+
+#endif
@@ -0,0 +1,480 @@
+#ifndef JASS_PRERENDER_HH
+#define JASS_PRERENDER_HH
+
+#include <vector>
+#include <algorithm>
+
+#include <poll.h>
+#include <pthread.h>
+
+#include <jack/jack.h>
+
+#include "generator.h"
+#include "voice.h"
+#include "ringbuffer.h"
+#include "event_fd.h"
+#include "rt_log.h"
+#include "memory_usage.h"
+
+/**
+	Renders the release tails of voices ahead of time in a thread of its own,
+	so the process thread only has to mix them in.
+
+	Once a voice is in RELEASE, what it plays next only depends on its state,
+	its generator's render descriptor, the channel's pitch bend and the render
+	profile. The process thread copies all of that into a free slot (see
+	hand_off()) and the worker renders the voice from there in chunks of
+	chunk_frames frames into the slot's ring of chunks, storing the voice's
+	state after each chunk along with it.
+
+	The process thread keeps rendering the voice itself until the worker is
+	lookahead_chunks ahead of it, then mixes the chunks instead (see mix()).
+	At each chunk boundary it takes over the voice's state of the worker, so
+	it can give the voice back to itself at any chunk boundary: when the
+	worker falls behind, when the generator's parameters, the pitch bend or
+	the render profile changed since the hand off, the voice continues where
+	the worker left off. Such changes reach a tail at most chunk_frames late.
+	Fades (stealing, choking, all sound off) are applied while mixing.
+
+	A slot binds the voice's generator (see generator::bound_voices) from the
+	hand off until the worker let go of it, which can be well after the voice
+	itself was stolen, cut off or its pool swapped. So the generator and with
+	it the sample and mipmaps the worker reads stay out of heap::cleanup()'s
+	reach. flush() unbinds the slots the worker is done with.
+
+	The slots are only ever handed between the threads: a slot is the
+	process thread's while owned is set and the worker's while idle is not.
+	A slot which is neither owned nor bound is free.
+	The chunks are a single producer single consumer ring, with written
+	and read counting the chunks.
+*/
+struct prerenderer {
+	enum { chunk_frames = 128 };
+
+	struct slot {
+		//! Written by the process thread before the slot is queued, then only used by the worker
+		voice v;
+		render_descriptor hot;
+		const sample *sample_;
+
+		//! The generator of the voice, bound while the worker may use the slot. Only used in the process thread
+		generator *gen;
+		jack_nframes_t frame_time;
+		jack_nframes_t sample_rate;
+		int min_interpolation;
+		int max_interpolation;
+		bool retire_silent;
+		double silence_threshold;
+
+		//! What the tail was handed off with, see stale(). Only used in the process thread
+		int pitch_bend;
+
+		//! Set once the process thread mixes the chunks instead of rendering the voice itself
+		bool switched;
+
+		//! The process thread uses this slot
+		bool owned;
+
+		//! The worker does not use this slot
+		volatile bool idle;
+
+		//! Set by the process thread when it gave the voice back, the worker then lets go of the slot
+		volatile bool cancelled;
+
+		//! The chunks rendered and mixed. Chunk n starts at frame_time + n * chunk_frames
+		volatile unsigned int written;
+		volatile unsigned int read;
+
+		//! The ring of chunks and the voice state at the end of each
+		std::vector<float> out_0;
+		std::vector<float> out_1;
+		std::vector<voice> after;
+
+		slot() :
+			sample_(0),
+			gen(0),
+			frame_time(0),
+			sample_rate(48000),
+			min_interpolation(LINEAR_INTERPOLATION),
+			max_interpolation(LINEAR_INTERPOLATION),
+			retire_silent(true),
+			silence_threshold(0),
+			pitch_bend(0),
+			switched(false),
+			owned(false),
+			idle(true),
+			cancelled(false),
+			written(0),
+			read(0)
+		{
+
+		}
+	};
+
+	//! Set through a command after start(). The process thread only touches the slots if this is set
+	bool enabled;
+
+	//! Only voices with at least this many frames of release left are handed off
+	jack_nframes_t min_tail_frames;
+
+	//! The chunks in each slot's ring and how many the worker has to be ahead before they are mixed in
+	unsigned int chunks;
+	unsigned int lookahead_chunks;
+
+	std::vector<slot> slots;
+
+	//! The slots handed off, from the process thread to the worker
+	ringbuffer<unsigned int> requests;
+
+	//! Wakes up the worker
+	event_fd wake;
+
+	prerenderer() :
+		enabled(false),
+		min_tail_frames(4800),
+		chunks(64),
+		lookahead_chunks(16),
+		requests(1024),
+		woken(false),
+		running(false),
+		quit(false)
+	{
+
+	}
+
+	~prerenderer() {
+		stop();
+	}
+
+	/**
+		Allocate number_of_slots slots and start the worker. Only call this
+		in the GUI thread while enabled is not set.
+	*/
+	void start(unsigned int number_of_slots) {
+		stop();
+
+		slots.assign(number_of_slots, slot());
+		for (unsigned int index = 0; index < slots.size(); ++index) {
+			slots[index].out_0.assign(chunks * chunk_frames, 0);
+			slots[index].out_1.assign(chunks * chunk_frames, 0);
+			slots[index].after.assign(chunks, voice());
+		}
+
+		quit = false;
+		running = 0 == pthread_create(&thread, 0, &prerenderer::run_thread, this);
+	}
+
+	//! Only call this in the GUI thread while enabled is not set
+	void stop() {
+		if (!running) return;
+
+		quit = true;
+		wake.signal();
+		pthread_join(thread, 0);
+		running = false;
+
+		for (unsigned int index = 0; index < slots.size(); ++index) unbind(slots[index]);
+	}
+
+	/**
+		Give the rest of voice v, which is in RELEASE and plays g, to the
+		worker. The tail starts at frame_time. Sets v.tail if a slot was free.
+		Only call this in the process thread.
+	*/
+	inline void hand_off(
+		voice &v, generator &g,
+		jack_nframes_t frame_time, jack_nframes_t sample_rate,
+		int min_interpolation, int max_interpolation,
+		bool retire_silent, double silence_threshold,
+		int pitch_bend
+	) {
+		if (!requests.can_write()) return;
+
+		for (unsigned int index = 0; index < slots.size(); ++index) {
+			slot &t = slots[index];
+			if (t.owned || t.gen) continue;
+
+			++g.bound_voices;
+			t.gen = &g;
+			t.v = v;
+			t.hot = g.hot;
+			t.sample_ = &g.sample_->t;
+			t.frame_time = frame_time;
+			t.sample_rate = sample_rate;
+			t.min_interpolation = min_interpolation;
+			t.max_interpolation = max_interpolation;
+			t.retire_silent = retire_silent;
+			t.silence_threshold = silence_threshold;
+			t.pitch_bend = pitch_bend;
+			t.switched = false;
+			t.owned = true;
+			t.cancelled = false;
+			t.written = t.read = 0;
+			t.idle = false;
+
+			//! The slot has to be complete before the worker can see it
+			__sync_synchronize();
+			requests.write(index);
+			woken = true;
+
+			v.tail = index;
+			return;
+		}
+	}
+
+	/**
+		Whether the tail of v is out of date, i.e. it was handed off with
+		another render descriptor, pitch bend or interpolation than the current
+		ones. Only call this in the process thread.
+	*/
+	inline bool stale(const voice &v, const render_descriptor &hot, int pitch_bend, int min_interpolation, int max_interpolation) const {
+		const slot &t = slots[v.tail];
+		return
+			t.hot.revision != hot.revision || t.pitch_bend != pitch_bend
+			|| t.min_interpolation != min_interpolation || t.max_interpolation != max_interpolation;
+	}
+
+	/**
+		Mix frames frames of the tail of voice v, starting at frame_time, into
+		out_0 and out_1. Returns the number of frames mixed.
+
+		As long as the worker is not far enough ahead this mixes nothing and the
+		caller renders the voice itself, as usual. If stale is set the tail is
+		given back at the next chunk boundary, as it is when the worker falls
+		behind. In both cases v.tail is reset and the caller renders the
+		remaining frames itself. Turns v OFF when it is done. Only call this in
+		the process thread.
+	*/
+	inline unsigned int mix(voice &v, float *out_0, float *out_1, unsigned int frames, jack_nframes_t frame_time, bool stale, rt_log &log) {
+		slot &t = slots[v.tail];
+
+		unsigned int written = t.written;
+		__sync_synchronize();
+
+		if (!t.switched) {
+			//! Drop the chunks the process thread rendered itself in the meantime
+			const jack_nframes_t elapsed = frame_time - t.frame_time;
+			while (t.read != written && elapsed >= (t.read + 1) * chunk_frames) consume(t);
+
+			if (stale || v.fade_remaining != 0) {
+				release(v);
+				return 0;
+			}
+
+			if (t.read == written) return 0;
+
+			const bool finished = t.after[(written - 1) % chunks].state == voice::OFF;
+			if (written - t.read <= lookahead_chunks && !finished) return 0;
+
+			t.switched = true;
+		}
+
+		unsigned int mixed = 0;
+		while (mixed < frames) {
+			const unsigned int chunk = t.read % chunks;
+			const unsigned int offset = (frame_time + mixed - t.frame_time) - t.read * chunk_frames;
+			const unsigned int count = std::min((unsigned int)chunk_frames - offset, frames - mixed);
+			const float *in_0 = &t.out_0[chunk * chunk_frames + offset];
+			const float *in_1 = &t.out_1[chunk * chunk_frames + offset];
+
+			if (v.fade_remaining == 0) {
+				for (unsigned int frame = 0; frame < count; ++frame) {
+					out_0[mixed + frame] += in_0[frame];
+					out_1[mixed + frame] += in_1[frame];
+				}
+			} else {
+				for (unsigned int frame = 0; frame < count; ++frame) {
+					const float fade = (float)v.fade_remaining / (float)v.fade_frames;
+					out_0[mixed + frame] += fade * in_0[frame];
+					out_1[mixed + frame] += fade * in_1[frame];
+
+					if (--v.fade_remaining == 0) {
+						v.state = voice::OFF;
+						release(v);
+						return mixed + frame + 1;
+					}
+				}
+			}
+			mixed += count;
+
+			if (offset + count < chunk_frames) continue;
+
+			//! Take over the worker's state, keeping the fade
+			const unsigned int fade_remaining = v.fade_remaining;
+			const unsigned int fade_frames = v.fade_frames;
+			const int tail = v.tail;
+			v = t.after[chunk];
+			v.fade_remaining = fade_remaining;
+			v.fade_frames = fade_frames;
+			v.tail = tail;
+			consume(t);
+
+			if (v.state == voice::OFF || stale) {
+				release(v);
+				return mixed;
+			}
+
+			written = t.written;
+			__sync_synchronize();
+			if (t.read == written) {
+				log.write(rt_log::PRERENDER_UNDERRUN, frame_time + mixed, v.note);
+				release(v);
+				return mixed;
+			}
+		}
+
+		return mixed;
+	}
+
+	/**
+		Let go of the tail of v. The slot stays bound until the worker let go of
+		it as well, see flush(). Only call this in the process thread.
+	*/
+	inline void release(voice &v) {
+		slot &t = slots[v.tail];
+		t.owned = false;
+		t.cancelled = true;
+		woken = true;
+		v.tail = -1;
+	}
+
+	/**
+		Call this at the end of each period. Unbinds the slots nobody uses
+		anymore and wakes up the worker if there is anything new for it. Only
+		call this in the process thread.
+	*/
+	inline void flush() {
+		for (unsigned int index = 0; index < slots.size(); ++index) {
+			if (!slots[index].owned && slots[index].idle) unbind(slots[index]);
+		}
+
+		if (!woken) return;
+		woken = false;
+		wake.signal();
+	}
+
+	size_t memory() const {
+		size_t bytes = sizeof(prerenderer) + vector_memory(slots) + vector_memory(requests.elements) + requests.jack_ringbuffer->size;
+		for (unsigned int index = 0; index < slots.size(); ++index) {
+			bytes += vector_memory(slots[index].out_0) + vector_memory(slots[index].out_1) + vector_memory(slots[index].after);
+		}
+		return bytes;
+	}
+
+	/**
+		Whether the worker rendered all tails as far ahead as it can and let go
+		of the slots given back. Offline renders wait for this before each period
+		so they do not depend on the worker's timing (see reference_render.cc).
+	*/
+	bool caught_up() const {
+		for (unsigned int index = 0; index < slots.size(); ++index) {
+			const slot &t = slots[index];
+			if (!t.owned) {
+				if (!t.idle) return false;
+				continue;
+			}
+
+			const unsigned int written = t.written;
+			__sync_synchronize();
+			const bool finished = written > 0 && t.after[(written - 1) % chunks].state == voice::OFF;
+			if (!finished && written - t.read < chunks) return false;
+		}
+		return true;
+	}
+
+	protected:
+		//! The worker is done with t, so its generator may go
+		static inline void unbind(slot &t) {
+			if (!t.gen) return;
+
+			//! Make sure the worker is done with the generator before heap::cleanup() can see it unused
+			__sync_synchronize();
+			--t.gen->bound_voices;
+			t.gen = 0;
+		}
+
+		//! Set in the process thread if the worker should look at the slots again, see flush()
+		bool woken;
+
+		pthread_t thread;
+		bool running;
+		volatile bool quit;
+
+		//! The process thread is done with the chunk at t.read, the worker may overwrite it
+		static inline void consume(slot &t) {
+			__sync_synchronize();
+			t.read = t.read + 1;
+		}
+
+		void run() {
+			//! The slots the worker renders, in the order they were handed off
+			std::vector<unsigned int> rendering;
+			rendering.reserve(slots.size());
+
+			while (!quit) {
+				while (requests.can_read()) rendering.push_back(requests.read());
+				__sync_synchronize();
+
+				bool progress = false;
+				for (unsigned int index = 0; index < rendering.size();) {
+					slot &t = slots[rendering[index]];
+
+					//! A few chunks at a time, so all tails move ahead
+					for (unsigned int n = 0; n < 4 && !t.cancelled && t.v.state != voice::OFF && t.written - t.read < chunks; ++n) {
+						render_chunk(t);
+						progress = true;
+					}
+
+					if (t.cancelled || t.v.state == voice::OFF) {
+						__sync_synchronize();
+						t.idle = true;
+						rendering.erase(rendering.begin() + index);
+					} else {
+						++index;
+					}
+				}
+
+				if (!progress) {
+					pollfd p;
+					p.fd = wake.fd;
+					p.events = POLLIN;
+					poll(&p, 1, 10);
+					wake.drain();
+				}
+			}
+
+			for (unsigned int index = 0; index < rendering.size(); ++index) slots[rendering[index]].idle = true;
+		}
+
+		inline void render_chunk(slot &t) {
+			const unsigned int chunk = t.written % chunks;
+			float *out_0 = &t.out_0[chunk * chunk_frames];
+			float *out_1 = &t.out_1[chunk * chunk_frames];
+			std::fill(out_0, out_0 + chunk_frames, 0.0f);
+			std::fill(out_1, out_1 + chunk_frames, 0.0f);
+
+			generator::render(
+				t.hot, t.v, out_0, out_1, chunk_frames,
+				t.frame_time + t.written * chunk_frames, t.sample_rate,
+				t.min_interpolation, t.max_interpolation
+			);
+			if (t.retire_silent) generator::retire_if_silent(t.hot, *t.sample_, t.v, t.silence_threshold);
+
+			t.after[chunk] = t.v;
+
+			//! The chunk has to be complete before the process thread can see it
+			__sync_synchronize();
+			t.written = t.written + 1;
+		}
+
+		static void *run_thread(void *arg) {
+			((prerenderer*)arg)->run();
+			return 0;
+		}
+
+	private:
+		prerenderer(const prerenderer&);
+		prerenderer &operator=(const prerenderer&);
+};
+
+#endif
@@ -0,0 +1,161 @@
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <stdint.h>
+
+#include "generator.h"
+
+/**
+	Renders the golden files of the reference_render setups the original
+	engine can play with its per frame generator::process(). Built by
+	render.sh against the original tree, so the golden files are not just the
+	new code agreeing with itself. Everything here has to stay in sync with
+	reference_render.cc and synthetic.h: the sample data, the generator
+	settings and the MIDI.
+*/
+
+static const double sample_rate = 16000;
+static const unsigned int render_frames = 8192;
+
+//! The original engine's voice slot
+struct gvoice {
+	disposable_generator_ptr g;
+	voice v;
+};
+
+//! As in synthetic.h
+struct lcg {
+	uint32_t state;
+
+	lcg(uint32_t seed) : state(seed) { }
+
+	uint32_t next() {
+		state = state * 1664525u + 1013904223u;
+		return state >> 8;
+	}
+
+	uint32_t below(uint32_t n) {
+		return next() % n;
+	}
+};
+
+//! Only the setups without features the original engine lacks. index is the one in reference_render.cc's table
+struct setup {
+	const char *name;
+	unsigned int channels;
+	bool looping;
+	unsigned int index;
+};
+
+static const setup setups[] = {
+	{ "mono",      1, false, 0 },
+	{ "stereo",    2, false, 1 },
+	{ "mono-loop", 1, true,  2 }
+};
+
+/**
+	synthetic_sample() laid out like the original sample.h: one extra frame
+	filled with 0, and a mono file plays the same data on both channels
+*/
+static disposable_sample_ptr synthetic_sample(unsigned int frames, unsigned int channels, double frequency, lcg &random) {
+	sample s;
+	s.data_0.assign(frames + 1, 0);
+	s.data_1.assign(frames + 1, 0);
+
+	for (unsigned int frame = 0; frame < frames; ++frame) {
+		const double t = frame / sample_rate;
+		const double noise = (random.below(2000) / 1000.0 - 1.0) * 0.01;
+		s.data_0[frame] = (float)(0.5 * exp(-t * 2.0) * sin(2 * M_PI * frequency * t) + noise);
+		s.data_1[frame] = channels == 2 ? (float)(0.5 * exp(-t * 2.0) * cos(2 * M_PI * frequency * t) + noise) : s.data_0[frame];
+	}
+
+	return disposable_sample::create(s);
+}
+
+//! The original engine's process_note_on(), round robin over the voices
+static void note_on(std::vector<gvoice> &voices, unsigned int &current_voice, disposable_generator_ptr g, jack_nframes_t nframes, unsigned int note, unsigned int velocity) {
+	voices[current_voice].g = g;
+	voices[current_voice].v.channel = 0;
+	voices[current_voice].v.note = note;
+	voices[current_voice].v.note_on_velocity = velocity;
+	voices[current_voice].v.note_on_frame = nframes;
+	voices[current_voice].v.state = voice::ATTACK;
+	current_voice = (current_voice + 1) % voices.size();
+}
+
+//! The original engine's process_note_off()
+static void note_off(std::vector<gvoice> &voices, jack_nframes_t nframes, unsigned int note) {
+	for (unsigned int index = 0; index < voices.size(); ++index) {
+		if (voices[index].v.state == voice::ATTACK && voices[index].v.channel == 0 && voices[index].v.note == note) {
+			voices[index].v.state = voice::RELEASE;
+			voices[index].v.note_off_frame = nframes;
+		}
+	}
+}
+
+static std::vector<float> render(const setup &s) {
+	lcg random(4711 + s.index);
+	disposable_sample_ptr sample_ = synthetic_sample((unsigned int)sample_rate, s.channels, 220, random);
+
+	disposable_generator_ptr g = disposable_generator::create(generator(s.name, sample_));
+	g->t.looping = s.looping;
+	g->t.loop_start = 0.2;
+	g->t.loop_end = 0.3;
+	g->t.attack_g = 0.03;
+	g->t.decay_g = 0.1;
+	g->t.sustain_g = -6;
+	g->t.release_g = 0.1;
+
+	//! reference_render.cc's midi_of()
+	static const int intervals[] = { 0, 4, 7, 12, -5, 3, 9 };
+	static const unsigned int notes = sizeof(intervals) / sizeof(intervals[0]);
+
+	std::vector<gvoice> voices(16);
+	unsigned int current_voice = 0;
+
+	std::vector<float> out_0(render_frames, 0), out_1(render_frames, 0);
+	for (jack_nframes_t frame = 0; frame < render_frames; ++frame) {
+		for (unsigned int index = 0; index < notes; ++index) {
+			const jack_nframes_t on = 17 + index * 1003;
+			if (frame == on + 1511) note_off(voices, frame, 60 + intervals[index]);
+			if (frame == on) note_on(voices, current_voice, g, frame, 60 + intervals[index], 120 - index * 13);
+		}
+
+		for (unsigned int index = 0; index < voices.size(); ++index) {
+			if (voices[index].v.state != voice::OFF) {
+				voices[index].g->t.process(&out_0[0], &out_1[0], 0, frame, (jack_nframes_t)sample_rate, voices[index].v);
+			}
+		}
+	}
+
+	std::vector<float> out;
+	out.reserve(2 * render_frames);
+	for (unsigned int frame = 0; frame < render_frames; ++frame) {
+		out.push_back(out_0[frame]);
+		out.push_back(out_1[frame]);
+	}
+	return out;
+}
+
+int main(int argc, char **argv) {
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s golden-dir\n", argv[0]);
+		return 1;
+	}
+
+	for (unsigned int index = 0; index < sizeof(setups) / sizeof(setups[0]); ++index) {
+		const std::vector<float> out = render(setups[index]);
+
+		const std::string file_name = std::string(argv[1]) + "/" + setups[index].name + ".f32";
+		FILE *file = fopen(file_name.c_str(), "wb");
+		if (file == 0 || fwrite(&out[0], sizeof(float), out.size(), file) != out.size() || fclose(file) != 0) {
+			fprintf(stderr, "Could not write %s\n", file_name.c_str());
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Writes the golden files of the setups the original engine can play (see
+# render.cc) with the per frame renderer of commit $1 (default: the first
+# one, before the block renderer). Needs g++ (or $CXX), boost and the jack
+# headers. Extra compiler flags can be passed in $CXXFLAGS.
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+top=$(cd "$here/../.." && pwd)
+commit=${1:-$(git -C "$top" rev-list --max-parents=0 HEAD)}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+git -C "$top" archive "$commit" generator.h voice.h adsr.h disposable.h disposable_base.h heap.h heap.cc | tar -x -C "$work"
+cp "$here/sample.h" "$here/render.cc" "$work"
+
+${CXX:-g++} -O2 $CXXFLAGS -I"$work" -o "$work/render" "$work/render.cc" "$work/heap.cc"
+"$work/render" "$here/.."
@@ -0,0 +1,20 @@
+#ifndef SAMPLE_HH
+#define SAMPLE_HH
+
+#include <vector>
+#include <string>
+
+#include "disposable.h"
+
+//! Stands in for the original sample.h, which only adds loading and resampling a file
+struct sample {
+	std::vector<float> data_0;
+	std::vector<float> data_1;
+
+	std::string file_name;
+};
+
+typedef disposable<sample> disposable_sample;
+typedef boost::shared_ptr<disposable<sample> > disposable_sample_ptr;
+
+#endif
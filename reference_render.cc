@@ -0,0 +1,335 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+
+#include "engine_core.h"
+#include "synthetic.h"
+
+/**
+	Renders fixed setups and MIDI offline through engine_core with a fixed
+	period size, once with the optimised kernels and once with the reference
+	kernels (see generator::reference_render), and compares both to each other
+	and to golden files. A second optimised render must be bit-exact. A third
+	one with the release tails prerendered (see prerender.h) has to match the
+	first within the setup's tolerances. Exits with 1 if anything is off by
+	more than the tolerances.
+
+	The golden files are raw interleaved stereo floats (native byte order),
+	one per setup. Those of the setups the original engine can play (marked
+	baseline) are rendered by its per frame generator::process(), see
+	reference/baseline/render.sh. The reference render has to match them
+	within --baseline-tolerance: the original engine kept released voices
+	at -70 dB until the end of the sample, which is all that differs. The
+	others use features the original engine lacks and are written from the
+	reference render by --write-golden, which leaves the baseline ones
+	alone. The reference render evaluates everything per frame, so it does
+	not depend on the period size and has to match them closely. Rewrite
+	them only when the reference path changes on purpose.
+*/
+
+namespace po = boost::program_options;
+
+static const double sample_rate = 16000;
+static const unsigned int render_frames = 8192;
+
+//! A generator configuration and the MIDI played on it
+struct setup {
+	const char *name;
+	unsigned int channels;
+	bool looping;
+	double tune;
+	int filter_type;
+	double filter_envelope_amount;
+	double release;
+	unsigned int polyphony;
+	bool sustain_pedal;
+	bool pitch_bend;
+	int interpolation;
+
+	//! Octaves of mipmaps to build, see mipmap.h
+	unsigned int mipmap_octaves;
+
+	//! The golden file comes from the original engine, see reference/baseline/render.cc
+	bool baseline;
+
+	//! How far the optimised render may be off the reference render: about 10% more
+	//! than measured over periods from 1 to 8192 frames. The envelope blocks and
+	//! the filter coefficients updated per block account for most of it, the resonant
+	//! band-pass's even more
+	double max_difference;
+	double rms_difference;
+};
+
+static const setup setups[] = {
+	// name                 channels looping tune  filter           env   release poly pedal  bend   interpolation          mipmaps baseline max    rms
+	{ "mono",               1,       false,  0,    FILTER_OFF,      0,    0.1,    16,  false, false, LINEAR_INTERPOLATION,  0,      true,    0.048, 2.3e-3 },
+	{ "stereo",             2,       false,  0,    FILTER_OFF,      0,    0.1,    16,  false, false, LINEAR_INTERPOLATION,  0,      true,    0.048, 2.3e-3 },
+	{ "mono-loop",          1,       true,   0,    FILTER_OFF,      0,    0.1,    16,  false, false, LINEAR_INTERPOLATION,  0,      true,    0.048, 2.3e-3 },
+	{ "stereo-loop-tuned",  2,       true,   37,   FILTER_OFF,      0,    0.1,    16,  false, true,  LINEAR_INTERPOLATION,  0,      false,   0.059, 1.9e-3 },
+	{ "low-pass",           2,       false,  0,    FILTER_LOWPASS,  2,    0.1,    16,  false, false, LINEAR_INTERPOLATION,  0,      false,   0.051, 2.5e-3 },
+	{ "band-pass-loop",     1,       true,   -12,  FILTER_BANDPASS, -1,   0.1,    16,  false, true,  LINEAR_INTERPOLATION,  0,      false,   0.2,   0.016 },
+	{ "sustain",            2,       false,  0,    FILTER_OFF,      0,    0.2,    16,  true,  false, LINEAR_INTERPOLATION,  0,      false,   0.049, 2.3e-3 },
+	{ "stealing",           1,       true,   0,    FILTER_OFF,      0,    0.3,    2,   false, false, LINEAR_INTERPOLATION,  0,      false,   0.049, 2.3e-3 },
+	{ "cubic-loop-tuned",   2,       true,   37,   FILTER_OFF,      0,    0.1,    16,  false, true,  CUBIC_INTERPOLATION,   0,      false,   0.059, 1.9e-3 },
+	{ "sinc8-mono",         1,       false,  -7,   FILTER_OFF,      0,    0.1,    16,  false, false, SINC_8_INTERPOLATION,  0,      false,   0.051, 2.4e-3 },
+	{ "sinc16-loop-tuned",  2,       true,   37,   FILTER_OFF,      0,    0.1,    16,  false, true,  SINC_16_INTERPOLATION, 0,      false,   0.059, 1.9e-3 },
+	{ "sinc32-stealing",    1,       true,   0,    FILTER_OFF,      0,    0.3,    2,   false, false, SINC_32_INTERPOLATION, 0,      false,   0.048, 2.3e-3 },
+	{ "mipmap-octave-up",   2,       true,   1200, FILTER_OFF,      0,    0.1,    16,  false, true,  SINC_16_INTERPOLATION, 2,      false,   0.053, 1.8e-3 }
+};
+
+struct timed_event {
+	jack_nframes_t frame;
+	unsigned char data[3];
+};
+
+static void add(std::vector<timed_event> &events, jack_nframes_t frame, unsigned char status, unsigned char data_1, unsigned char data_2) {
+	timed_event e;
+	e.frame = frame;
+	e.data[0] = status;
+	e.data[1] = data_1;
+	e.data[2] = data_2;
+	events.push_back(e);
+}
+
+static bool earlier(const timed_event &a, const timed_event &b) {
+	return a.frame < b.frame;
+}
+
+//! Overlapping notes at odd frames, so they do not line up with the periods or the envelope blocks
+static std::vector<timed_event> midi_of(const setup &s) {
+	static const int intervals[] = { 0, 4, 7, 12, -5, 3, 9 };
+
+	std::vector<timed_event> events;
+	for (unsigned int index = 0; index < sizeof(intervals) / sizeof(intervals[0]); ++index) {
+		const jack_nframes_t on = 17 + index * 1003;
+		add(events, on, 0x90, 60 + intervals[index], 120 - index * 13);
+		add(events, on + 1511, 0x80, 60 + intervals[index], 0);
+	}
+
+	if (s.sustain_pedal) {
+		add(events, 1201, 0xb0, 64, 127);
+		add(events, 5999, 0xb0, 64, 0);
+	}
+
+	if (s.pitch_bend) {
+		for (jack_nframes_t frame = 2003; frame < 4000; frame += 251) {
+			const unsigned int value = 8192 + (frame - 2003) * 3;
+			add(events, frame, 0xe0, value & 0x7f, (value >> 7) & 0x7f);
+		}
+	}
+
+	std::stable_sort(events.begin(), events.end(), earlier);
+	return events;
+}
+
+//! Render the setup, interleaved stereo
+static std::vector<float> render(const setup &s, disposable_sample_ptr sample_, bool reference, unsigned int period, bool prerender = false) {
+	engine_core core(sample_rate);
+
+	disposable_generator_ptr g = disposable_generator::create(generator(s.name, sample_));
+	g->t.looping = s.looping;
+	g->t.loop_start = 0.2;
+	g->t.loop_end = 0.3;
+	g->t.tune = s.tune;
+	g->t.filter_type = s.filter_type;
+	g->t.filter_cutoff = 800;
+	g->t.filter_q = 4;
+	g->t.filter_envelope_amount = s.filter_envelope_amount;
+	g->t.attack_g = 0.03;
+	g->t.decay_g = 0.1;
+	g->t.sustain_g = -6;
+	g->t.release_g = s.release;
+	g->t.interpolation = s.interpolation;
+	if (s.mipmap_octaves > 0) {
+		g->t.mipmaps_ = disposable_mipmaps::create();
+		g->t.mipmaps_->t.build(sample_->t, s.mipmap_octaves);
+	}
+	g->t.reference_render = reference;
+	g->t.update();
+
+	disposable_generator_vector_ptr gens = disposable_generator_vector::create(generator_vector());
+	gens->t.push_back(g);
+
+	//! Nothing runs yet, so set things directly instead of through commands
+	core.gens = gens;
+	core.set_voices(engine_core::create_voices(s.polyphony), s.polyphony);
+
+	//! Hand off every tail, the releases are short
+	if (prerender) {
+		core.prerender_.min_tail_frames = 0;
+		core.prerender_.start(8);
+		core.prerender_.enabled = true;
+	}
+
+	const std::vector<timed_event> midi = midi_of(s);
+	std::vector<jack_midi_event_t> events(midi.size());
+
+	std::vector<float> out_0(period), out_1(period);
+	std::vector<float> out;
+	out.reserve(2 * render_frames);
+
+	unsigned int midi_index = 0;
+	for (jack_nframes_t frame_time = 0; frame_time < render_frames; frame_time += period) {
+		unsigned int count = 0;
+		while (midi_index < midi.size() && midi[midi_index].frame < frame_time + period) {
+			events[count].time = midi[midi_index].frame - frame_time;
+			events[count].size = 3;
+			events[count].buffer = const_cast<unsigned char*>(midi[midi_index].data);
+			++count;
+			++midi_index;
+		}
+
+		//! Let the worker get as far ahead as it can, so the render does not depend on its timing
+		while (!core.prerender_.caught_up()) usleep(100);
+
+		core.process(&out_0[0], &out_1[0], count > 0 ? &events[0] : 0, count, period, frame_time, (jack_nframes_t)sample_rate);
+
+		for (unsigned int frame = 0; frame < period; ++frame) {
+			out.push_back(out_0[frame]);
+			out.push_back(out_1[frame]);
+		}
+	}
+
+	out.resize(2 * render_frames);
+	return out;
+}
+
+struct difference {
+	double max_abs;
+	double rms;
+};
+
+static difference compare(const std::vector<float> &a, const std::vector<float> &b) {
+	difference d = { 0, 0 };
+	if (a.size() != b.size()) {
+		d.max_abs = d.rms = HUGE_VAL;
+		return d;
+	}
+
+	double sum = 0;
+	for (unsigned int index = 0; index < a.size(); ++index) {
+		const double e = (double)a[index] - (double)b[index];
+		d.max_abs = std::max(d.max_abs, fabs(e));
+		sum += e * e;
+	}
+	d.rms = a.empty() ? 0 : sqrt(sum / a.size());
+	return d;
+}
+
+static bool read_golden(const std::string &file_name, std::vector<float> &data) {
+	std::ifstream file(file_name.c_str(), std::ios::binary);
+	if (!file.good()) return false;
+
+	data.resize(2 * render_frames);
+	file.read((char*)&data[0], data.size() * sizeof(float));
+	data.resize(file.gcount() / sizeof(float));
+	return true;
+}
+
+static bool write_golden(const std::string &file_name, const std::vector<float> &data) {
+	std::ofstream file(file_name.c_str(), std::ios::binary);
+	file.write((const char*)&data[0], data.size() * sizeof(float));
+	return file.good();
+}
+
+//! Print one comparison line and tell whether it is within the tolerances
+static bool report(const setup &s, const char *comparison, const difference &d, double max_tolerance, double rms_tolerance) {
+	const bool ok = d.max_abs <= max_tolerance && d.rms <= rms_tolerance;
+
+	std::cout
+		<< std::left << std::setw(20) << s.name
+		<< std::setw(24) << comparison
+		<< std::right << std::scientific << std::setprecision(3)
+		<< std::setw(12) << d.max_abs
+		<< std::setw(12) << d.rms
+		<< "  " << (ok ? "ok" : "FAILED")
+		<< std::endl;
+
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	std::string golden_dir;
+	unsigned int period;
+	double golden_tolerance;
+	double baseline_tolerance;
+
+	po::options_description desc("Allowed options:");
+	desc.add_options()
+		("help,h", "Produce this help message")
+		("golden-dir,d", po::value<std::string>(&golden_dir)->default_value("reference"), "Where the golden files are")
+		("write-golden,w", "Write the reference renders to the golden files (except the baseline ones) instead of checking against them")
+		("period,n", po::value<unsigned int>(&period)->default_value(64), "Period size")
+		("golden-tolerance", po::value<double>(&golden_tolerance)->default_value(1e-5), "Allowed maximum absolute difference of the reference renders to the golden files")
+		("baseline-tolerance", po::value<double>(&baseline_tolerance)->default_value(3e-4), "Dito for the golden files rendered by the original engine")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) { std::cout << desc << std::endl; return 0; }
+
+	if (period == 0) {
+		std::cerr << "The period size must be at least 1" << std::endl;
+		return 1;
+	}
+
+	bool ok = true;
+
+	std::cout
+		<< std::left << std::setw(20) << "setup"
+		<< std::setw(24) << "comparison"
+		<< std::right << std::setw(12) << "max"
+		<< std::setw(12) << "rms"
+		<< std::endl;
+
+	for (unsigned int index = 0; index < sizeof(setups) / sizeof(setups[0]); ++index) {
+		const setup &s = setups[index];
+
+		lcg random(4711 + index);
+		disposable_sample_ptr sample_ = synthetic_sample(s.name, (unsigned int)sample_rate, s.channels, 220, sample_rate, random);
+
+		const std::vector<float> optimised = render(s, sample_, false, period);
+		const std::vector<float> again = render(s, sample_, false, period);
+		const std::vector<float> reference = render(s, sample_, true, period);
+		const std::vector<float> prerendered = render(s, sample_, false, period, true);
+
+		ok = report(s, "optimised (twice)", compare(optimised, again), 0, 0) && ok;
+		ok = report(s, "optimised vs reference", compare(optimised, reference), s.max_difference, s.rms_difference) && ok;
+		ok = report(s, "optimised vs prerendered", compare(optimised, prerendered), s.max_difference, s.rms_difference) && ok;
+
+		const std::string file_name = golden_dir + "/" + s.name + ".f32";
+		if (vm.count("write-golden")) {
+			if (!s.baseline && !write_golden(file_name, reference)) {
+				std::cerr << "Could not write " << file_name << std::endl;
+				ok = false;
+			}
+			continue;
+		}
+
+		std::vector<float> golden;
+		if (!read_golden(file_name, golden)) {
+			std::cerr << "Could not read " << file_name << std::endl;
+			ok = false;
+			continue;
+		}
+
+		const double reference_tolerance = s.baseline ? baseline_tolerance : golden_tolerance;
+		ok = report(s, "reference vs golden", compare(reference, golden), reference_tolerance, reference_tolerance) && ok;
+		ok = report(s, "optimised vs golden", compare(optimised, golden), s.max_difference, s.rms_difference) && ok;
+	}
+
+	heap::get()->cleanup();
+	delete heap::get();
+
+	return ok ? 0 : 1;
+}
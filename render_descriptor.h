@@ -0,0 +1,205 @@
+#ifndef JASS_RENDER_DESCRIPTOR_HH
+#define JASS_RENDER_DESCRIPTOR_HH
+
+#include <stdint.h>
+#include <string.h>
+
+#include <cmath>
+#include <algorithm>
+
+#include <boost/static_assert.hpp>
+
+#include "render_kernel.h"
+#include "filter.h"
+
+/**
+	The playback increments for note differences of -Semitones to Semitones - 1,
+	built during static initialization (instance) so the first note on does
+	not pay for the pow() calls in the process thread.
+*/
+template <int Semitones>
+struct stretch_table {
+	double factors[2 * Semitones];
+
+	static const stretch_table instance;
+
+	stretch_table() {
+		for (int i = 0; i < 2 * Semitones; ++i)
+			factors[i] = (i - Semitones != 0) ? pow(pow(2.0, 1.0/12.0), i - Semitones) : 1.0;
+	}
+};
+
+template <int Semitones>
+const stretch_table<Semitones> stretch_table<Semitones>::instance;
+
+/**
+	The playback increments for note differences of -128 to 127 semitones,
+	shared by all generators. Index with the difference directly, i.e.
+	stretch_factors()[0] == 1.0.
+*/
+inline const double *stretch_factors() {
+	return stretch_table<128>::instance.factors + 128;
+}
+
+//! 2^(cents/1200) for 0 to Cents - 1 cents, built during static initialization like stretch_table
+template <int Cents>
+struct cent_table {
+	double factors[Cents];
+
+	static const cent_table instance;
+
+	cent_table() {
+		for (int i = 0; i < Cents; ++i)
+			factors[i] = pow(2.0, i / 1200.0);
+	}
+};
+
+template <int Cents>
+const cent_table<Cents> cent_table<Cents>::instance;
+
+//! 2^(cents/1200) for 0 to 99 cents, i.e. the fine part of pitch_ratio()
+inline const double *cent_factors() {
+	return cent_table<100>::instance.factors;
+}
+
+//! The playback increment for a pitch offset in cents (1/100 semitone). Two table lookups, no pow()
+inline double pitch_ratio(int cents) {
+	cents = std::min(std::max(cents, -12800), 12799);
+
+	//! Round towards negative infinity, so the fine part is always 0 to 99
+	const int semitones = (cents + 12800) / 100 - 128;
+	return stretch_factors()[semitones] * cent_factors()[cents - semitones * 100];
+}
+
+//! 2^(i/Steps) for i = 0 to Steps, built during static initialization like stretch_table
+template <int Steps>
+struct exp2_table {
+	double factors[Steps + 1];
+
+	static const exp2_table instance;
+
+	exp2_table() {
+		for (int i = 0; i <= Steps; ++i)
+			factors[i] = pow(2.0, (double)i / Steps);
+	}
+};
+
+template <int Steps>
+const exp2_table<Steps> exp2_table<Steps>::instance;
+
+/**
+	2^x without pow(): a linear interpolation in a table of 256 steps per
+	octave, off by less than 1e-6 relative (1e-5 dB). For the per block
+	envelope and filter cutoff modulation in the process thread.
+*/
+inline double fast_exp2(double x) {
+	enum { steps = 256 };
+
+	x = std::min(std::max(x, -1000.0), 1000.0);
+	int octave = (int)x;
+	if (octave > x) --octave;
+
+	//! x - octave is exact and below 1, so index stays below steps
+	const double position = (x - octave) * steps;
+	const int index = (int)position;
+	const double *f = exp2_table<steps>::instance.factors;
+
+	//! 2^octave straight from the exponent bits, ldexp() is a library call
+	const uint64_t bits = (uint64_t)(octave + 1023) << 52;
+	double scale;
+	memcpy(&scale, &bits, sizeof(scale));
+	return (f[index] + (position - index) * (f[index + 1] - f[index])) * scale;
+}
+
+//! 10^(db/20), see fast_exp2()
+inline double fast_db_to_gain(double db) {
+	return fast_exp2(db * (M_LN10 / M_LN2 / 20.0));
+}
+
+struct mipmap_level;
+
+/**
+	Everything the process thread needs to render the voices of a generator,
+	precomputed from the generator's parameters by generator::update(). What
+	a kernel call needs comes first and fills the first cache line, the
+	envelope and filter follow in the second. Whatever is only needed at
+	note on stays in generator, and the mipmap levels are only pointed to.
+*/
+struct render_descriptor {
+	render_region region;
+
+	//! The kernel pairs for each interpolation, see select_render_functions()
+	const render_function_pair *kernels;
+
+	//! The levels of the generator's sample_mipmaps, 0 if there are none. Level n is n + 1 octaves down (see mipmap.h)
+	const mipmap_level *mipmaps;
+
+	int interpolation;
+
+	//! The envelope is evaluated every envelope_block frames, see generator::render()
+	unsigned int envelope_block;
+
+	//! The number of levels in mipmaps that voices may read
+	enum { max_mipmap_levels = 8 };
+	unsigned int mipmap_levels;
+
+	//! The generator gain as a linear factor, 0 if muted
+	float gain;
+
+	//! The velocity gain is (velocity - min_velocity) * velocity_scale
+	float min_velocity;
+	float velocity_scale;
+
+	//! The envelope in seconds and dB, see adsr.h
+	float attack;
+	float decay;
+	float sustain;
+	float release;
+
+	//! See filter.h. The cutoff is modulated by velocity and envelope in octaves
+	int filter_type;
+	float filter_cutoff;
+	float filter_q;
+	float filter_velocity_amount;
+	float filter_envelope_amount;
+
+	//! The fine tuning in cents
+	int tune;
+
+	//! Counts the update()s, so a copy can tell it is out of date
+	unsigned int revision;
+
+	//! Whether kernels are the looping ones, see generator::loops()
+	bool looping;
+
+	render_descriptor() :
+		kernels(0),
+		mipmaps(0),
+		interpolation(LINEAR_INTERPOLATION),
+		envelope_block(1),
+		mipmap_levels(0),
+		gain(0),
+		min_velocity(0),
+		velocity_scale(0),
+		attack(0),
+		decay(0),
+		sustain(0),
+		release(0),
+		filter_type(FILTER_OFF),
+		filter_cutoff(20000),
+		filter_q(M_SQRT1_2),
+		filter_velocity_amount(0),
+		filter_envelope_amount(0),
+		tune(0),
+		revision(0),
+		looping(false)
+	{
+		region.data_0 = region.data_1 = 0;
+		region.end_frame = region.loop_start_frame = region.loop_end_frame = 0;
+	}
+};
+
+//! Keep it at two cache lines (on 64 bit), it is read for every voice and block
+BOOST_STATIC_ASSERT(sizeof(render_descriptor) <= 128);
+
+#endif
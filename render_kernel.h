@@ -0,0 +1,239 @@
+#ifndef JASS_RENDER_KERNEL_HH
+#define JASS_RENDER_KERNEL_HH
+
+#include <cmath>
+#include <algorithm>
+#include <string>
+
+#include "voice.h"
+#include "sinc_table.h"
+
+//! How a sample is read at fractional positions, from the cheapest to the best
+enum interpolation {
+	LINEAR_INTERPOLATION,
+	CUBIC_INTERPOLATION,
+	SINC_8_INTERPOLATION,
+	SINC_16_INTERPOLATION,
+	SINC_32_INTERPOLATION,
+	NUMBER_OF_INTERPOLATIONS
+};
+
+//! As used in the setup files
+static const char * const interpolation_names[NUMBER_OF_INTERPOLATIONS] = { "linear", "cubic", "sinc8", "sinc16", "sinc32" };
+
+//! Returns -1 for an unknown name
+inline int interpolation_of_name(const std::string &name) {
+	for (int interpolation = 0; interpolation < NUMBER_OF_INTERPOLATIONS; ++interpolation) {
+		if (name == interpolation_names[interpolation]) return interpolation;
+	}
+	return -1;
+}
+
+//! The part of a generator and its sample the render kernels need. Positions are in frames
+struct render_region {
+	const float *data_0;
+	const float *data_1;
+
+	//! The voice turns OFF when it reaches this
+	double end_frame;
+
+	//! Only used by the looping kernels
+	double loop_start_frame;
+	double loop_end_frame;
+};
+
+template <int Interpolation>
+inline float interpolate(const float *data, unsigned int index, float mix);
+
+template <>
+inline float interpolate<LINEAR_INTERPOLATION>(const float *data, unsigned int index, float mix) {
+	return data[index] + mix * (data[index + 1] - data[index]);
+}
+
+//! 4 point, 3rd order Hermite. Reads one frame before index, see sample::padding
+template <>
+inline float interpolate<CUBIC_INTERPOLATION>(const float *data, unsigned int index, float mix) {
+	const float *d = data + index;
+	const float c1 = 0.5f * (d[1] - d[-1]);
+	const float c2 = d[-1] - 2.5f * d[0] + 2.0f * d[1] - 0.5f * d[2];
+	const float c3 = 0.5f * (d[2] - d[-1]) + 1.5f * (d[0] - d[1]);
+	return ((c3 * mix + c2) * mix + c1) * mix + d[0];
+}
+
+//! Windowed sincs, see sinc_table.h
+template <>
+inline float interpolate<SINC_8_INTERPOLATION>(const float *data, unsigned int index, float mix) {
+	return sinc_table<8>::instance.interpolate(data, index, mix);
+}
+
+template <>
+inline float interpolate<SINC_16_INTERPOLATION>(const float *data, unsigned int index, float mix) {
+	return sinc_table<16>::instance.interpolate(data, index, mix);
+}
+
+template <>
+inline float interpolate<SINC_32_INTERPOLATION>(const float *data, unsigned int index, float mix) {
+	return sinc_table<32>::instance.interpolate(data, index, mix);
+}
+
+//! What reference_kernel() uses: the same as interpolate(), but without SSE
+template <int Interpolation>
+inline float interpolate_reference(const float *data, unsigned int index, float mix) {
+	return interpolate<Interpolation>(data, index, mix);
+}
+
+template <>
+inline float interpolate_reference<SINC_8_INTERPOLATION>(const float *data, unsigned int index, float mix) {
+	return sinc_table<8>::instance.interpolate_reference(data, index, mix);
+}
+
+template <>
+inline float interpolate_reference<SINC_16_INTERPOLATION>(const float *data, unsigned int index, float mix) {
+	return sinc_table<16>::instance.interpolate_reference(data, index, mix);
+}
+
+template <>
+inline float interpolate_reference<SINC_32_INTERPOLATION>(const float *data, unsigned int index, float mix) {
+	return sinc_table<32>::instance.interpolate_reference(data, index, mix);
+}
+
+/**
+	The innermost loop. It has no end or loop checks, render_kernel() splits
+	the frames into runs which never cross the end or the loop end.
+*/
+template <unsigned int Channels, int Interpolation, bool Ramp>
+inline void render_run(
+	const float *data_0, const float *data_1,
+	float *out_0, float *out_1,
+	const unsigned int frames,
+	double &position, const double increment,
+	float &gain, const float gain_step
+) {
+	double p = position;
+	float g = gain;
+
+	for (unsigned int frame = 0; frame < frames; ++frame) {
+		const unsigned int index = (unsigned int)p;
+		const float mix = (float)(p - index);
+
+		const float s_0 = interpolate<Interpolation>(data_0, index, mix);
+		const float s_1 = (Channels == 2) ? interpolate<Interpolation>(data_1, index, mix) : s_0;
+
+		out_0[frame] += g * s_0;
+		out_1[frame] += g * s_1;
+
+		p += increment;
+		if (Ramp) g += gain_step;
+	}
+
+	position = p;
+	gain = g;
+}
+
+/**
+	Render frames frames of voice v starting at gain and ramping by gain_step per
+	frame. Turns the voice OFF when it reaches the end of the region.
+*/
+template <bool Looping, unsigned int Channels, int Interpolation, bool Ramp>
+void render_kernel(const render_region &r, voice &v, float *out_0, float *out_1, unsigned int frames, float gain, const float gain_step) {
+	while (frames > 0) {
+		if (Looping && v.position >= r.loop_end_frame) {
+			v.position = r.loop_start_frame + fmod(v.position - r.loop_start_frame, r.loop_end_frame - r.loop_start_frame);
+		}
+
+		const double end = Looping ? r.loop_end_frame : r.end_frame;
+		if (v.position < 0 || v.position >= end) {
+			v.state = voice::OFF;
+			return;
+		}
+
+		const unsigned int run = (unsigned int)std::min((double)frames, ceil((end - v.position) / v.increment));
+		render_run<Channels, Interpolation, Ramp>(r.data_0, r.data_1, out_0, out_1, run, v.position, v.increment, gain, gain_step);
+
+		out_0 += run;
+		out_1 += run;
+		frames -= run;
+	}
+}
+
+/**
+	The plain version of render_kernel(): one frame at a time with the end and
+	loop checks in the loop and the channel count checked at run time. Slow, but
+	easy to verify. generator::reference_render uses these to validate the
+	optimised kernels against, see reference_render.cc.
+*/
+template <bool Looping, int Interpolation, bool Ramp>
+void reference_kernel(const render_region &r, voice &v, float *out_0, float *out_1, unsigned int frames, float gain, const float gain_step) {
+	for (unsigned int frame = 0; frame < frames; ++frame) {
+		if (Looping && v.position >= r.loop_end_frame) {
+			v.position = r.loop_start_frame + fmod(v.position - r.loop_start_frame, r.loop_end_frame - r.loop_start_frame);
+		}
+
+		const double end = Looping ? r.loop_end_frame : r.end_frame;
+		if (v.position < 0 || v.position >= end) {
+			v.state = voice::OFF;
+			return;
+		}
+
+		const unsigned int index = (unsigned int)v.position;
+		const float mix = (float)(v.position - index);
+
+		const float s_0 = interpolate_reference<Interpolation>(r.data_0, index, mix);
+		const float s_1 = (r.data_1 != 0) ? interpolate_reference<Interpolation>(r.data_1, index, mix) : s_0;
+
+		out_0[frame] += gain * s_0;
+		out_1[frame] += gain * s_1;
+
+		v.position += v.increment;
+		if (Ramp) gain += gain_step;
+	}
+}
+
+typedef void (*render_function)(const render_region &, voice &, float *, float *, unsigned int, float, float);
+
+//! Index 0 for a constant gain (e.g. during sustain), index 1 for a gain ramp
+typedef render_function render_function_pair[2];
+
+//! The kernels of a configuration for each interpolation
+template <bool Looping, unsigned int Channels>
+struct render_function_table {
+	static const render_function_pair pairs[NUMBER_OF_INTERPOLATIONS];
+};
+
+template <bool Looping, unsigned int Channels>
+const render_function_pair render_function_table<Looping, Channels>::pairs[NUMBER_OF_INTERPOLATIONS] = {
+	{ &render_kernel<Looping, Channels, LINEAR_INTERPOLATION, false>, &render_kernel<Looping, Channels, LINEAR_INTERPOLATION, true> },
+	{ &render_kernel<Looping, Channels, CUBIC_INTERPOLATION, false>, &render_kernel<Looping, Channels, CUBIC_INTERPOLATION, true> },
+	{ &render_kernel<Looping, Channels, SINC_8_INTERPOLATION, false>, &render_kernel<Looping, Channels, SINC_8_INTERPOLATION, true> },
+	{ &render_kernel<Looping, Channels, SINC_16_INTERPOLATION, false>, &render_kernel<Looping, Channels, SINC_16_INTERPOLATION, true> },
+	{ &render_kernel<Looping, Channels, SINC_32_INTERPOLATION, false>, &render_kernel<Looping, Channels, SINC_32_INTERPOLATION, true> }
+};
+
+template <bool Looping>
+struct reference_function_table {
+	static const render_function_pair pairs[NUMBER_OF_INTERPOLATIONS];
+};
+
+template <bool Looping>
+const render_function_pair reference_function_table<Looping>::pairs[NUMBER_OF_INTERPOLATIONS] = {
+	{ &reference_kernel<Looping, LINEAR_INTERPOLATION, false>, &reference_kernel<Looping, LINEAR_INTERPOLATION, true> },
+	{ &reference_kernel<Looping, CUBIC_INTERPOLATION, false>, &reference_kernel<Looping, CUBIC_INTERPOLATION, true> },
+	{ &reference_kernel<Looping, SINC_8_INTERPOLATION, false>, &reference_kernel<Looping, SINC_8_INTERPOLATION, true> },
+	{ &reference_kernel<Looping, SINC_16_INTERPOLATION, false>, &reference_kernel<Looping, SINC_16_INTERPOLATION, true> },
+	{ &reference_kernel<Looping, SINC_32_INTERPOLATION, false>, &reference_kernel<Looping, SINC_32_INTERPOLATION, true> }
+};
+
+/**
+	Returns the kernel pairs of a configuration, indexed by interpolation.
+	reference selects the reference_kernel()s. Call this when the configuration
+	changes (generator::update(), which may run in the process thread), not in
+	the inner loops.
+*/
+inline const render_function_pair *select_render_functions(bool looping, unsigned int channels, bool reference = false) {
+	if (reference) return looping ? reference_function_table<true>::pairs : reference_function_table<false>::pairs;
+
+	if (looping) return channels == 2 ? render_function_table<true, 2>::pairs : render_function_table<true, 1>::pairs;
+	return channels == 2 ? render_function_table<false, 2>::pairs : render_function_table<false, 1>::pairs;
+}
+
+#endif
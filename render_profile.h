@@ -0,0 +1,48 @@
+#ifndef JASS_RENDER_PROFILE_HH
+#define JASS_RENDER_PROFILE_HH
+
+#include "render_kernel.h"
+
+/**
+	The quality settings the process thread renders with. engine_core uses
+	the live profile for playing in real time and the freewheel profile while
+	JACK freewheels (e.g. for an offline bounce), where there is no deadline
+	to meet and the best quality can be afforded.
+*/
+struct render_profile {
+	//! The generators read their samples with at least min_interpolation and at most max_interpolation, whatever their own is (see render_kernel.h)
+	int min_interpolation;
+	int max_interpolation;
+
+	//! Apply the polyphony and the generators' max_voices. Otherwise voices are only stolen when the voice pool is exhausted
+	bool voice_limits;
+
+	//! Turn voices off early once they can not become audible anymore, see generator::retire_if_silent()
+	bool retire_silent;
+
+	render_profile(
+		int min_interpolation = LINEAR_INTERPOLATION,
+		int max_interpolation = NUMBER_OF_INTERPOLATIONS - 1,
+		bool voice_limits = true,
+		bool retire_silent = true
+	) :
+		min_interpolation(min_interpolation),
+		max_interpolation(max_interpolation),
+		voice_limits(voice_limits),
+		retire_silent(retire_silent)
+	{
+
+	}
+
+	//! The generators' own settings
+	static render_profile live() {
+		return render_profile(LINEAR_INTERPOLATION, NUMBER_OF_INTERPOLATIONS - 1, true, true);
+	}
+
+	//! The best there is
+	static render_profile freewheel() {
+		return render_profile(NUMBER_OF_INTERPOLATIONS - 1, NUMBER_OF_INTERPOLATIONS - 1, false, false);
+	}
+};
+
+#endif
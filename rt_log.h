@@ -0,0 +1,194 @@
+#ifndef JASS_RT_LOG_HH
+#define JASS_RT_LOG_HH
+
+#include <jack/jack.h>
+#include <jack/ringbuffer.h>
+
+#include <cstdio>
+#include <string>
+
+#include <boost/function.hpp>
+
+#include "event_fd.h"
+
+/**
+	A lock free log channel out of the process thread. The process thread
+	only copies fixed size records into a jack ringbuffer, all formatting
+	happens in drain() which is called in the GUI thread.
+
+	Each code is rate limited separately: at most rate_limit records per
+	window of window_frames are passed on. The number of suppressed records
+	is reported once the window is over (by the next write() of the code or
+	by flush(), whichever comes first), so a stuck condition cannot flood
+	the GUI. Records lost to a full ringbuffer are counted and reported by
+	flush() as soon as there is room again.
+*/
+struct rt_log {
+	enum code {
+		ACK_BUFFER_FULL,
+		VOICE_STOLEN,
+		SUPPRESSED,
+		RENDER_PROFILE_CHANGED,
+		LOAD_LEVEL_CHANGED,
+		PRERENDER_UNDERRUN,
+		LOST,
+		NUMBER_OF_CODES
+	};
+
+	struct record {
+		unsigned int code;
+		jack_nframes_t frame;
+		int args[3];
+	};
+
+	jack_ringbuffer_t *jack_ringbuffer;
+
+	//! Signalled by flush() if records were written since the last flush()
+	event_fd event;
+
+	unsigned int rate_limit;
+	jack_nframes_t window_frames;
+
+	jack_nframes_t window_start[NUMBER_OF_CODES];
+	unsigned int count[NUMBER_OF_CODES];
+	unsigned int suppressed[NUMBER_OF_CODES];
+
+	//! Number of records lost because the ringbuffer was full
+	unsigned int overflows;
+
+	bool dirty;
+
+	rt_log(unsigned int size = 1024, unsigned int rate_limit = 10, jack_nframes_t window_frames = 48000) :
+		rate_limit(rate_limit),
+		window_frames(window_frames),
+		overflows(0),
+		dirty(false)
+	{
+		jack_ringbuffer = jack_ringbuffer_create(sizeof(record) * size);
+		for (unsigned int index = 0; index < NUMBER_OF_CODES; ++index) {
+			window_start[index] = 0;
+			count[index] = 0;
+			suppressed[index] = 0;
+		}
+	}
+
+	~rt_log() {
+		jack_ringbuffer_free(jack_ringbuffer);
+	}
+
+	//! Only call this in the process thread
+	void write(code c, jack_nframes_t frame, int arg0 = 0, int arg1 = 0, int arg2 = 0) {
+		if (frame - window_start[c] >= window_frames) close_window(c, frame);
+
+		if (count[c] >= rate_limit) {
+			++suppressed[c];
+			return;
+		}
+
+		++count[c];
+		push(c, frame, arg0, arg1, arg2);
+	}
+
+	/**
+		Call this once at the end of the process callback, with frame the time
+		of the first frame after it. Reports the suppressed records of windows
+		which are over and the records lost since the last report, then wakes
+		up the GUI.
+	*/
+	void flush(jack_nframes_t frame) {
+		for (unsigned int c = 0; c < NUMBER_OF_CODES; ++c) {
+			if (suppressed[c] > 0 && frame - window_start[c] >= window_frames) close_window(c, frame);
+		}
+
+		if (overflows > 0 && jack_ringbuffer_write_space(jack_ringbuffer) >= sizeof(record)) {
+			const unsigned int lost = overflows;
+			overflows = 0;
+			push(LOST, frame, lost, 0, 0);
+		}
+
+		if (!dirty) return;
+		dirty = false;
+		event.signal();
+	}
+
+	//! Only call this in the GUI thread. Formats all pending records and passes them to sink
+	void drain(boost::function<void(const std::string&)> sink) {
+		event.drain();
+
+		record r;
+		while (jack_ringbuffer_read_space(jack_ringbuffer) >= sizeof(record)) {
+			jack_ringbuffer_read(jack_ringbuffer, (char*)&r, sizeof(record));
+			sink(format(r));
+		}
+	}
+
+	//! A short name per code, for records which refer to other codes (SUPPRESSED)
+	static const char *name(unsigned int c) {
+		static const char *names[NUMBER_OF_CODES] = {
+			"acknowledgement buffer full",
+			"voice stolen",
+			"suppressed",
+			"render profile switched",
+			"load governor level",
+			"prerender underrun",
+			"lost"
+		};
+
+		return c < NUMBER_OF_CODES ? names[c] : "unknown";
+	}
+
+	static std::string format(const record &r) {
+		static const char *formats[NUMBER_OF_CODES] = {
+			"acknowledgement buffer full, an acknowledgement was lost",
+			"voice %d stolen (note %d replaced by note %d)",
+			"suppressed %d \"%s\" messages",
+			"render profile switched (freewheeling: %d)",
+			"load governor level %d -> %d (load %d%% of the period)",
+			"the prerendered release of note %d ran dry, the process thread renders it again",
+			"lost %d messages, the log buffer was full"
+		};
+
+		char message[256];
+		char line[300];
+		if (r.code == SUPPRESSED) {
+			snprintf(message, sizeof(message), formats[r.code], r.args[0], name(r.args[1]));
+		} else if (r.code < NUMBER_OF_CODES) {
+			snprintf(message, sizeof(message), formats[r.code], r.args[0], r.args[1], r.args[2]);
+		} else {
+			snprintf(message, sizeof(message), "unknown message %u", r.code);
+		}
+		snprintf(line, sizeof(line), "[engine, frame %u] %s", r.frame, message);
+		return line;
+	}
+
+	protected:
+		//! Report what code c suppressed in its last window and start a new one at frame
+		void close_window(unsigned int c, jack_nframes_t frame) {
+			if (suppressed[c] > 0) push(SUPPRESSED, frame, suppressed[c], c, 0);
+			window_start[c] = frame;
+			count[c] = 0;
+			suppressed[c] = 0;
+		}
+
+		void push(unsigned int c, jack_nframes_t frame, int arg0, int arg1, int arg2) {
+			if (jack_ringbuffer_write_space(jack_ringbuffer) < sizeof(record)) {
+				++overflows;
+				return;
+			}
+
+			record r;
+			r.code = c;
+			r.frame = frame;
+			r.args[0] = arg0;
+			r.args[1] = arg1;
+			r.args[2] = arg2;
+			jack_ringbuffer_write(jack_ringbuffer, (const char*)&r, sizeof(record));
+			dirty = true;
+		}
+
+	private:
+		rt_log(const rt_log&);
+		rt_log &operator=(const rt_log&);
+};
+
+#endif
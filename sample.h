@@ -8,19 +8,59 @@
 #include <fstream>
 #include <stdexcept>
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
 #include <sndfile.h>
 #include <samplerate.h>
 
 #include "disposable.h"
+#include "memory_usage.h"
 
 
 struct sample {
+	//! data_1 is empty for mono samples. Both start and end with padding zero frames, see begin_0()
 	std::vector<float> data_0;
 	std::vector<float> data_1;
 
 	std::string file_name;
 
+	//! The number of frames, not counting the padding
+	unsigned int frames;
+	unsigned int channels;
+
+	//! Zero frames before and after the data, so interpolating kernels can read around the first and the last frame. Half the longest sinc (see render_kernel.h)
+	enum { padding = 16 };
+
+	//! The first frame of channel 0 and 1 (0 for mono samples)
+	inline const float *begin_0() const { return &data_0[padding]; }
+	inline const float *begin_1() const { return channels == 2 ? &data_1[padding] : 0; }
+
+	//! The resolution of the peak table
+	enum { peak_segment_frames = 1024 };
+
+	//! tail_peaks[n] is the peak level of both channels from segment n to the end of the sample
+	std::vector<float> tail_peaks;
+
+	//! The peak level of the sample from frame to the end
+	inline float tail_peak(unsigned int frame) const {
+		return tail_peaks[std::min<unsigned int>(frame / peak_segment_frames, tail_peaks.size() - 1)];
+	}
+
+	//! A sample from frames in memory, e.g. a synthetic one. An empty data_1 makes it mono
+	sample(const std::string &name, const std::vector<float> &data_0, const std::vector<float> &data_1 = std::vector<float>()) :
+		data_0(data_0.size() + 2 * padding, 0),
+		data_1(data_1.empty() ? 0 : data_1.size() + 2 * padding, 0),
+		file_name(name),
+		frames(data_0.size()),
+		channels(data_1.empty() ? 1 : 2)
+	{
+		std::copy(data_0.begin(), data_0.end(), this->data_0.begin() + padding);
+		if (channels == 2) std::copy(data_1.begin(), data_1.end(), this->data_1.begin() + padding);
+
+		build_peak_table();
+	}
+
 	sample(const std::string &file_name, jack_nframes_t samplerate) :
 		file_name(file_name)
 	{
@@ -37,37 +77,52 @@ struct sample {
 
 		std::cout << "read: " << sf_readf_float(snd_file, &frames[0], sf_info.frames) << " samples from " << file_name << std::endl;
 		
-		std::vector<float> out_frames(sf_info.channels * sf_info.frames * (samplerate/sf_info.samplerate));
+		const double ratio = (double)samplerate / (double)sf_info.samplerate;
+		std::vector<float> out_frames(sf_info.channels * (size_t)ceil(sf_info.frames * ratio));
 
 		SRC_DATA data;
 		data.data_in = &frames[0];
 		data.data_out = &out_frames[0];
 		data.input_frames = sf_info.frames;
-		data.output_frames = out_frames.size();
-		data.src_ratio = samplerate/sf_info.samplerate;
+		data.output_frames = out_frames.size() / sf_info.channels;
+		data.src_ratio = ratio;
 		src_simple(&data, SRC_SINC_BEST_QUALITY, sf_info.channels);
 
-		//! add one extra frame filled with 0 to make the interpolation in the generator easier
-		data_0.resize(sf_info.frames * (samplerate/sf_info.samplerate) + 1);
-		data_1.resize(sf_info.frames * (samplerate/sf_info.samplerate) + 1);
+		channels = sf_info.channels;
+		this->frames = data.output_frames_gen;
 
-		if (sf_info.channels == 1) {
-			std::copy(out_frames.begin(), out_frames.end(), data_0.begin());
-			std::copy(out_frames.begin(), out_frames.end(), data_0.begin());
+		//! add some extra frames filled with 0 to make the interpolation in the generator easier
+		data_0.resize(this->frames + 2 * padding, 0);
+		if (channels == 2) data_1.resize(this->frames + 2 * padding, 0);
+
+		for (unsigned int i = 0; i < this->frames; ++i) {
+			data_0[padding + i] = out_frames[channels * i];
+			if (channels == 2) data_1[padding + i] = out_frames[2 * i + 1];
 		}
 
-		data_0[data_0.size() - 1] = 0;
-		data_1[data_1.size() - 1] = 0;
+		build_peak_table();
+	}
+
+	void build_peak_table() {
+		const unsigned int segments = frames / peak_segment_frames + 1;
+		tail_peaks.assign(segments, 0);
+
+		for (unsigned int frame = 0; frame < frames; ++frame) {
+			float &peak = tail_peaks[frame / peak_segment_frames];
+			peak = std::max(peak, fabsf(begin_0()[frame]));
+			if (channels == 2) peak = std::max(peak, fabsf(begin_1()[frame]));
+		}
 
-		if (sf_info.channels == 2) {
-			for (unsigned int i = 0; i < sf_info.frames; ++i) {
-				data_0[i] = frames[2 * i];
-				data_1[i] = frames[2 * i + 1];
-			}
+		for (unsigned int segment = segments - 1; segment > 0; --segment) {
+			tail_peaks[segment - 1] = std::max(tail_peaks[segment - 1], tail_peaks[segment]);
 		}
 	}
 };
 
+inline size_t disposable_memory(const sample &s) {
+	return sizeof(sample) + vector_memory(s.data_0) + vector_memory(s.data_1) + vector_memory(s.tail_peaks) + string_memory(s.file_name);
+}
+
 typedef disposable<sample> disposable_sample;
 typedef boost::shared_ptr<disposable<sample> > disposable_sample_ptr;
 
@@ -4,6 +4,7 @@
 #include <QWidget>
 #include <QHBoxLayout>
 #include <QCheckBox>
+#include <QComboBox>
 
 #include "generator.h"
 #include "waveform_widget.h"
@@ -16,11 +17,16 @@ struct sample_range_widget : public QWidget {
 	disposable_generator_ptr gen;
 
 	QCheckBox *looping;
+	QComboBox *interpolation;
 
 	public slots:
 		void loop_changed(bool state) {
-			engine::get()->write_command(assign(gen->t.looping, state));
-			engine::get()->deferred_commands.write(boost::bind(&sample_range_widget::update, this));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.looping, state));
+			engine::get()->defer(boost::bind(&sample_range_widget::update, this));
+		}
+
+		void interpolation_changed(int index) {
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.interpolation, index));
 		}
 
 	public:
@@ -34,6 +40,18 @@ struct sample_range_widget : public QWidget {
 			looping->setToolTip("Toggle to enable looping");
 			connect(looping, SIGNAL(toggled(bool)), this, SLOT(loop_changed(bool)));
 			layout->addWidget(looping, 0);
+
+			interpolation = new QComboBox();
+			interpolation->addItem("Linear");
+			interpolation->addItem("Cubic");
+			interpolation->addItem("Sinc 8");
+			interpolation->addItem("Sinc 16");
+			interpolation->addItem("Sinc 32");
+			interpolation->setCurrentIndex(gen->t.interpolation);
+			interpolation->setToolTip("Interpolation. The better ones cost more CPU, see the benchmark");
+			connect(interpolation, SIGNAL(currentIndexChanged(int)), this, SLOT(interpolation_changed(int)));
+			layout->addWidget(interpolation, 0);
+
 			layout->addWidget(new waveform_widget(gen), 1);
 			setLayout(layout);
 		}
@@ -0,0 +1,103 @@
+#ifndef JASS_SINC_TABLE_HH
+#define JASS_SINC_TABLE_HH
+
+#include <cmath>
+#include <algorithm>
+
+#ifdef __SSE__
+	#include <xmmintrin.h>
+#endif
+
+/**
+	The polyphase coefficients of a Blackman windowed sinc with Taps taps.
+	Row p holds the taps for the fractional position p / phases, positions
+	in between interpolate the results of the two neighbouring rows. The
+	taps of a position between frames index and index + 1 start at frame
+	index - Taps / 2 + 1.
+
+	The cutoff is at (1 - 2 / Taps) of Nyquist and the window's transition
+	band around it is roughly 8 / Taps of Nyquist wide, so fewer taps trade
+	treble for speed. Each row is normalized to unity gain at DC.
+
+	The tables are built during static initialization (instance), never in
+	the process thread.
+*/
+template <unsigned int Taps>
+struct sinc_table {
+	enum { phases = 256 };
+
+	//! Rows are 16 byte aligned for the SSE loads, Taps is a multiple of 4
+	float coefficients[phases + 1][Taps] __attribute__((aligned(16)));
+
+	static const sinc_table instance;
+
+	sinc_table() {
+		const double cutoff = 1.0 - 2.0 / Taps;
+		const double half = Taps / 2.0;
+
+		for (unsigned int phase = 0; phase <= phases; ++phase) {
+			const double fraction = (double)phase / phases;
+
+			double sum = 0;
+			for (unsigned int tap = 0; tap < Taps; ++tap) {
+				//! The distance of the tap's frame from the position
+				const double x = (double)tap - (half - 1.0) - fraction;
+				const double sinc = (x == 0) ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+				const double w = (fabs(x) >= half) ? 0.0 : 0.42 + 0.5 * cos(M_PI * x / half) + 0.08 * cos(2.0 * M_PI * x / half);
+				coefficients[phase][tap] = (float)(sinc * w);
+				sum += sinc * w;
+			}
+
+			for (unsigned int tap = 0; tap < Taps; ++tap) coefficients[phase][tap] /= (float)sum;
+		}
+	}
+
+	//! The sample at mix between data[index] and data[index + 1]. Reads Taps / 2 frames around index, see sample::padding
+	inline float interpolate(const float *data, unsigned int index, float mix) const {
+		const float phase = mix * phases;
+		const unsigned int row = std::min((unsigned int)phase, (unsigned int)phases - 1);
+		const float fraction = phase - row;
+		const float *d = data + index - (Taps / 2 - 1);
+		const float *c_0 = coefficients[row];
+		const float *c_1 = coefficients[row + 1];
+
+#ifdef __SSE__
+		__m128 sum_0 = _mm_setzero_ps();
+		__m128 sum_1 = _mm_setzero_ps();
+		for (unsigned int tap = 0; tap < Taps; tap += 4) {
+			const __m128 x = _mm_loadu_ps(d + tap);
+			sum_0 = _mm_add_ps(sum_0, _mm_mul_ps(x, _mm_load_ps(c_0 + tap)));
+			sum_1 = _mm_add_ps(sum_1, _mm_mul_ps(x, _mm_load_ps(c_1 + tap)));
+		}
+
+		__m128 sum = _mm_add_ps(sum_0, _mm_mul_ps(_mm_set1_ps(fraction), _mm_sub_ps(sum_1, sum_0)));
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		return _mm_cvtss_f32(sum);
+#else
+		return interpolate_scalar(d, c_0, c_1, fraction);
+#endif
+	}
+
+	//! The same without SSE, one tap at a time. The reference kernels use this
+	inline float interpolate_reference(const float *data, unsigned int index, float mix) const {
+		const float phase = mix * phases;
+		const unsigned int row = std::min((unsigned int)phase, (unsigned int)phases - 1);
+		return interpolate_scalar(data + index - (Taps / 2 - 1), coefficients[row], coefficients[row + 1], phase - row);
+	}
+
+	protected:
+		static inline float interpolate_scalar(const float *d, const float *c_0, const float *c_1, float fraction) {
+			float sum_0 = 0, sum_1 = 0;
+			for (unsigned int tap = 0; tap < Taps; ++tap) {
+				sum_0 += d[tap] * c_0[tap];
+				sum_1 += d[tap] * c_1[tap];
+			}
+			return sum_0 + fraction * (sum_1 - sum_0);
+		}
+};
+
+template <unsigned int Taps>
+const sinc_table<Taps> sinc_table<Taps>::instance;
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef JASS_SYNTHETIC_HH
+#define JASS_SYNTHETIC_HH
+
+#include <vector>
+#include <string>
+#include <cmath>
+
+#include <stdint.h>
+
+#include "sample.h"
+
+//! A small deterministic random number generator, so runs are comparable
+struct lcg {
+	uint32_t state;
+
+	lcg(uint32_t seed) : state(seed) { }
+
+	uint32_t next() {
+		state = state * 1664525u + 1013904223u;
+		return state >> 8;
+	}
+
+	//! 0 <= result < n
+	uint32_t below(uint32_t n) {
+		return next() % n;
+	}
+};
+
+/**
+	A decaying sine (cosine on the second channel) at frequency Hz with some
+	noise from random, for the benchmark and the reference renders which must
+	not depend on sample files.
+*/
+inline disposable_sample_ptr synthetic_sample(
+	const std::string &name,
+	unsigned int frames,
+	unsigned int channels,
+	double frequency,
+	double sample_rate,
+	lcg &random
+) {
+	std::vector<float> data_0(frames);
+	std::vector<float> data_1;
+	if (channels == 2) data_1.resize(frames);
+
+	for (unsigned int frame = 0; frame < frames; ++frame) {
+		const double t = frame / sample_rate;
+		const double noise = (random.below(2000) / 1000.0 - 1.0) * 0.01;
+		data_0[frame] = (float)(0.5 * exp(-t * 2.0) * sin(2 * M_PI * frequency * t) + noise);
+		if (channels == 2) data_1[frame] = (float)(0.5 * exp(-t * 2.0) * cos(2 * M_PI * frequency * t) + noise);
+	}
+
+	return disposable_sample::create(sample(name, data_0, data_1));
+}
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef JASS_TRACE_HH
+#define JASS_TRACE_HH
+
+#include <stdint.h>
+#include <time.h>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+
+#if defined(__i386__) || defined(__x86_64__)
+	#include <x86intrin.h>
+#endif
+
+/**
+	A recorder for what the process thread was doing, for inspecting the
+	last few seconds before an xrun. Events are written with cycle counter
+	timestamps into a preallocated ring and dumped on demand in the Chrome
+	trace event format (load it in chrome://tracing or ui.perfetto.dev).
+
+	Recording is only compiled in if JASS_TRACE is defined (cmake -DJASS_TRACE=1),
+	otherwise all recording methods are empty. At runtime it is switched on
+	with enable(), which allocates the ring, and off with the enabled flag.
+*/
+struct trace {
+	enum type {
+		CALLBACK,
+		COMMAND,
+		NOTE_ON,
+		NOTE_OFF,
+		VOICE_ALLOCATE,
+		VOICE_STEAL,
+		VOICE_RENDER,
+		NUMBER_OF_TYPES
+	};
+
+	struct event {
+		uint64_t begin;
+		uint64_t end;
+		unsigned int type;
+		int arg0;
+		int arg1;
+	};
+
+	//! Empty until enable()
+	std::vector<event> events;
+	unsigned int size;
+	unsigned int write_pos;
+	bool wrapped;
+
+	volatile bool enabled;
+
+	//! Set while dump() reads the events, the process thread does not record then
+	volatile bool frozen;
+	volatile bool recording;
+
+	//! For converting cycles to microseconds in dump()
+	uint64_t calibration_ticks;
+	uint64_t calibration_ns;
+
+	trace(unsigned int size = 1 << 18) :
+		size(size),
+		write_pos(0),
+		wrapped(false),
+		enabled(false),
+		frozen(false),
+		recording(false),
+		calibration_ticks(now()),
+		calibration_ns(monotonic_ns())
+	{
+
+	}
+
+	//! Allocate the ring and start recording. Call this in the GUI thread. Does nothing without JASS_TRACE
+	void enable() {
+#ifdef JASS_TRACE
+		if (events.empty()) events.resize(size);
+		__sync_synchronize();
+		enabled = true;
+#endif
+	}
+
+	static inline uint64_t now() {
+#if defined(__i386__) || defined(__x86_64__)
+		return __rdtsc();
+#else
+		return monotonic_ns();
+#endif
+	}
+
+	static uint64_t monotonic_ns() {
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	}
+
+	//! Returns the start of a span. Costs nothing if tracing is not compiled in
+	inline uint64_t begin() const {
+#ifdef JASS_TRACE
+		if (enabled) return now();
+#endif
+		return 0;
+	}
+
+	//! Record a span which started at begin (taken with begin()) and ends now
+	inline void span(type t, uint64_t begin, int arg0 = 0, int arg1 = 0) {
+#ifdef JASS_TRACE
+		record(t, begin, now(), arg0, arg1);
+#else
+		(void)t; (void)begin; (void)arg0; (void)arg1;
+#endif
+	}
+
+	inline void instant(type t, int arg0 = 0, int arg1 = 0) {
+#ifdef JASS_TRACE
+		const uint64_t n = now();
+		record(t, n, n, arg0, arg1);
+#else
+		(void)t; (void)arg0; (void)arg1;
+#endif
+	}
+
+	inline void record(type t, uint64_t begin, uint64_t end, int arg0, int arg1) {
+		if (!enabled) return;
+
+		recording = true;
+		__sync_synchronize();
+		if (!frozen) {
+			event &e = events[write_pos];
+			e.begin = begin;
+			e.end = end;
+			e.type = t;
+			e.arg0 = arg0;
+			e.arg1 = arg1;
+			if (++write_pos == events.size()) {
+				write_pos = 0;
+				wrapped = true;
+			}
+		}
+		__sync_synchronize();
+		recording = false;
+	}
+
+	/**
+		Call this in the GUI thread. Recording pauses while the events are
+		written. Returns false if the file could not be written.
+	*/
+	bool dump(const std::string &file_name) {
+		static const char *names[NUMBER_OF_TYPES] = {
+			"callback",
+			"command",
+			"note on",
+			"note off",
+			"voice allocate",
+			"voice steal",
+			"voice render"
+		};
+
+		static const char *arg_names[NUMBER_OF_TYPES][2] = {
+			{ "frames", "frame time" },
+			{ "index", "" },
+			{ "note", "channel" },
+			{ "note", "channel" },
+			{ "voice", "note" },
+			{ "voice", "note" },
+			{ "voice", "frames" }
+		};
+
+		frozen = true;
+		__sync_synchronize();
+		while (recording) { }
+
+		const double ticks_per_us =
+			(double)(now() - calibration_ticks) / ((double)(monotonic_ns() - calibration_ns) / 1000.0);
+
+		std::ofstream f(file_name.c_str());
+		f << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+		const unsigned int count = wrapped ? events.size() : write_pos;
+		const unsigned int start = wrapped ? write_pos : 0;
+
+		//! Spans are recorded when they end, so the oldest begin is not necessarily the first one
+		uint64_t origin = count > 0 ? events[start].begin : 0;
+		for (unsigned int index = 0; index < count; ++index) {
+			origin = std::min(origin, events[(start + index) % events.size()].begin);
+		}
+
+		for (unsigned int index = 0; index < count; ++index) {
+			const event &e = events[(start + index) % events.size()];
+			if (index > 0) f << ",\n";
+
+			f
+				<< "{\"name\":\"" << names[e.type] << "\",\"cat\":\"engine\",\"pid\":1,\"tid\":1"
+				<< ",\"ts\":" << (double)(e.begin - origin) / ticks_per_us;
+
+			if (e.begin == e.end) f << ",\"ph\":\"i\",\"s\":\"t\"";
+			else f << ",\"ph\":\"X\",\"dur\":" << (double)(e.end - e.begin) / ticks_per_us;
+
+			f << ",\"args\":{\"" << arg_names[e.type][0] << "\":" << e.arg0;
+			if (arg_names[e.type][1][0] != 0) f << ",\"" << arg_names[e.type][1] << "\":" << e.arg1;
+			f << "}}";
+		}
+
+		f << "\n]}\n";
+
+		frozen = false;
+		return f.good();
+	}
+};
+
+#endif
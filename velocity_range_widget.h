@@ -35,22 +35,22 @@ struct velocity_range_widget : public QWidget {
 
 		void mouseMoveEvent(QMouseEvent *e) {
 			if ((e->buttons() & Qt::LeftButton)) {
-				engine::get()->write_command(assign(gen->t.max_velocity, std::max((unsigned int)((double)(e->x())/width() * 128), gen->t.min_velocity)));
+				engine::get()->write_command(assign_parameter(gen->t, gen->t.max_velocity, std::max((unsigned int)((double)(e->x())/width() * 128), gen->t.min_velocity)));
 				e->accept();
-				engine::get()->deferred_commands.write(boost::bind(&velocity_range_widget::update, this));
+				engine::get()->defer(boost::bind(&velocity_range_widget::update, this));
 			}
 		}
 
 		void mousePressEvent(QMouseEvent *e) {
 			if (e->button() == Qt::LeftButton) {
-				engine::get()->write_command(assign(gen->t.min_velocity, std::min((double)(e->x())/width() * 128, (double)(gen->t.max_velocity))));
+				engine::get()->write_command(assign_parameter(gen->t, gen->t.min_velocity, std::min((double)(e->x())/width() * 128, (double)(gen->t.max_velocity))));
 				e->accept();
-				engine::get()->deferred_commands.write(boost::bind(&velocity_range_widget::update, this));
+				engine::get()->defer(boost::bind(&velocity_range_widget::update, this));
 			}
 			if (e->button() == Qt::RightButton) {
-				engine::get()->write_command(assign(gen->t.max_velocity, std::max((double)(e->x())/width() * 128, (double)(gen->t.min_velocity))));
+				engine::get()->write_command(assign_parameter(gen->t, gen->t.max_velocity, std::max((double)(e->x())/width() * 128, (double)(gen->t.min_velocity))));
 				e->accept();
-				engine::get()->deferred_commands.write(boost::bind(&velocity_range_widget::update, this));
+				engine::get()->defer(boost::bind(&velocity_range_widget::update, this));
 			}
 		}
 
@@ -10,6 +10,7 @@
 #include "dial_widget.h"
 #include "engine.h"
 #include "assign.h"
+#include "controller_map.h"
 
 struct velocity_widget : public QWidget {
 	Q_OBJECT
@@ -23,11 +24,20 @@ struct velocity_widget : public QWidget {
 
 	public slots:
 		void factor_changed(double v) {
-			engine::get()->write_command(assign(gen->t.velocity_factor, v));
-			engine::get()->deferred_commands.write(boost::bind(&velocity_widget::update, this));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.velocity_factor, v));
+			engine::get()->defer(boost::bind(&velocity_widget::update, this));
+		}
+
+		void learn_factor() {
+			engine::get()->learn(gen, PARAMETER_VELOCITY_FACTOR);
 		}
 
 	public:
+		//! Show a value the engine settled on for parameter (see controller_feedback)
+		void show_parameter(int parameter, double value) {
+			if (parameter == PARAMETER_VELOCITY_FACTOR) factor->show_value(value);
+		}
+
 		velocity_widget(disposable_generator_ptr g, QWidget *parent = 0) :
 			QWidget(parent),
 			gen(g)
@@ -39,6 +49,7 @@ struct velocity_widget : public QWidget {
 			factor->set_value(gen->t.velocity_factor);
 			factor->setToolTip("Factor");
 			connect(factor, SIGNAL(valueChanged(double)), this, SLOT(factor_changed(double)));
+			connect(factor, SIGNAL(learn_requested()), this, SLOT(learn_factor()));
 			layout->addWidget(factor, 0);
 			layout->addWidget(new velocity_range_widget(gen), 1);
 			setLayout(layout);
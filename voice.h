@@ -4,8 +4,10 @@
 #include <jack/jack.h>
 #include <boost/shared_ptr.hpp>
 #include <vector>
+#include <algorithm>
 
 #include "disposable.h"
+#include "filter.h"
 
 
 struct voice {
@@ -22,17 +24,62 @@ struct voice {
 
 	//! Dito for note off
 	jack_nframes_t note_off_frame;
+
+	//! The linear gain of the last processed frame (used to find the quietest voice)
+	double gain;
+
+	//! The position in the sample of the next frame and how far it advances per frame
+	double position;
+	double increment;
+
+	//! The pitch relative to the sample in cents, without pitch bend (see generator::start())
+	int pitch;
+
+	//! The generator's fine tuning included in pitch, see generator::follow_tune()
+	int tune;
+
+	//! True while the envelope may still get louder (i.e. during the attack)
+	bool envelope_rising;
+
+	//! The linear envelope level at the end of the last processed block (for filter modulation)
+	double envelope;
+
+	svf filter;
+
+	//! If non-zero the voice was stolen or choked and fades out over the remaining frames
+	unsigned int fade_remaining;
+	unsigned int fade_frames;
+
+	//! The prerenderer slot rendering the rest of this voice's release or -1, see prerender.h
+	int tail;
 	
 	voice(unsigned int note_on_velocity = 0, jack_nframes_t note_on_frame = 0, bool playing = false) :
 		note_on_velocity(note_on_velocity),
 		note_on_frame(note_on_frame),
-		state(OFF)
+		state(OFF),
+		gain(0),
+		position(0),
+		increment(1),
+		pitch(0),
+		tune(0),
+		envelope_rising(true),
+		envelope(0),
+		fade_remaining(0),
+		fade_frames(0),
+		tail(-1)
 	{
 		setup_filters();
 	}
 
+	//! Start a short fade out, after which the voice turns OFF
+	void fade_out(unsigned int frames) {
+		if (fade_remaining != 0) return;
+		fade_frames = fade_remaining = std::max(frames, 1u);
+	}
+
+	//! Clear the filter state, call this whenever the voice is started
 	void setup_filters() {
-		
+		filter.reset();
 	}
 };
 
@@ -0,0 +1,292 @@
+#ifndef JASS_VOICE_POOL_HH
+#define JASS_VOICE_POOL_HH
+
+#include <stdint.h>
+
+#include <vector>
+#include <algorithm>
+
+#include <boost/shared_ptr.hpp>
+
+#include "disposable.h"
+#include "generator.h"
+#include "voice.h"
+#include "memory_usage.h"
+
+/**
+	The engine's preallocated voices, stored as parallel arrays. The render
+	state of a voice (the voice struct) is only touched when the voice is
+	rendered, while the scans over all voices (note off matching, looking
+	for free voices, checking for activity) only read the packed keys, four
+	bytes per voice in one contiguous array, which the compiler can vectorize.
+
+	The render state itself deliberately stays one voice struct per voice
+	rather than one array per field: generator::render() reads and writes
+	nearly all of it (position, increment, gain, envelope, filter state) for
+	one voice at a time over a whole period, so keeping a voice's fields
+	together means one or two cache lines per voice, where parallel arrays
+	would mean a line per field. Only what the scans read is split out.
+	There is no pass over all voices for the envelopes or the silence check
+	either: gain_at() branches on each voice's envelope stage and is under a
+	tenth of the render time (jass_benchmark, 256 and 1024 voices), and
+	generator::retire_if_silent() runs once per voice and period.
+
+	Whoever changes a voice's state, note or channel has to call update_key()
+	afterwards. Only use this in the process thread, except for construction.
+
+	Voices in ATTACK are also linked into a chain per (channel, note), so a
+	note off finds its voices without a scan. All active voices are linked
+	into a list per channel as well (kept by update_key()), so a pitch bend
+	only visits the voices of its channel.
+*/
+struct voice_pool {
+	std::vector<voice> voices;
+
+	/**
+		A raw pointer per voice, so binding a voice causes no reference count traffic
+		in the process thread and can never destroy a generator there. The generator
+		is kept alive by heap::cleanup() as long as generator::bound_voices is non-zero.
+	*/
+	std::vector<generator*> generators;
+
+	//! state, channel and note of each voice, see key()
+	std::vector<uint32_t> keys;
+
+	//! The active voices in render order, see sort_active()
+	std::vector<unsigned int> order;
+
+	enum { channels = 16, notes = 128, unlinked = -2, key_channels = 256 };
+
+	//! The first voice of each (channel, note) chain or -1
+	std::vector<int> chains;
+
+	//! The neighbours of each voice in its chain. chain_prev is unlinked if the voice is in no chain
+	std::vector<int> chain_next;
+	std::vector<int> chain_prev;
+
+	//! The first active voice of each channel (as in key_channel()) or -1, see first_on_channel()
+	std::vector<int> channel_heads;
+
+	//! The neighbours of each voice in its channel's list. channel_prev is unlinked if the voice is inactive
+	std::vector<int> channel_next;
+	std::vector<int> channel_prev;
+
+	voice_pool(unsigned int size = 0) :
+		voices(size),
+		generators(size, (generator*)0),
+		keys(size, key(voice::OFF, 0, 0)),
+		order(size),
+		chains(channels * notes, -1),
+		chain_next(size, -1),
+		chain_prev(size, (int)unlinked),
+		channel_heads(key_channels, -1),
+		channel_next(size, -1),
+		channel_prev(size, (int)unlinked)
+	{
+
+	}
+
+	//! Only call this with channel < channels and note < notes
+	static inline unsigned int chain_index(unsigned int channel, unsigned int note) {
+		return channel * notes + note;
+	}
+
+	/**
+		Link voice index into the chain of its channel and note. Unlink it before
+		changing either. Voices on other channels than the 16 MIDI ones (e.g. the
+		auditor's) stay unlinked, no note off can reach them anyway.
+	*/
+	inline void link(unsigned int index) {
+		if (voices[index].channel >= channels || voices[index].note >= notes) return;
+
+		int &head = chains[chain_index(voices[index].channel, voices[index].note)];
+		chain_next[index] = head;
+		chain_prev[index] = -1;
+		if (head >= 0) chain_prev[head] = index;
+		head = index;
+	}
+
+	inline void unlink(unsigned int index) {
+		const int prev = chain_prev[index];
+		if (prev == unlinked) return;
+
+		const int next = chain_next[index];
+		if (prev >= 0) chain_next[prev] = next;
+		else chains[chain_index(voices[index].channel, voices[index].note)] = next;
+		if (next >= 0) chain_prev[next] = prev;
+
+		chain_prev[index] = unlinked;
+		chain_next[index] = -1;
+	}
+
+	/**
+		Switch all voices of the chain of channel and note to RELEASE and empty
+		the chain. Costs only as much as there are voices in the chain.
+	*/
+	inline void release_chain(unsigned int channel, unsigned int note, jack_nframes_t frame) {
+		if (channel >= channels || note >= notes) return;
+
+		int &head = chains[chain_index(channel, note)];
+		int index = head;
+		while (index >= 0) {
+			const int next = chain_next[index];
+			voices[index].state = voice::RELEASE;
+			voices[index].note_off_frame = frame;
+			update_key(index);
+			chain_prev[index] = unlinked;
+			chain_next[index] = -1;
+			index = next;
+		}
+		head = -1;
+	}
+
+	static inline uint32_t key(unsigned int state, unsigned int channel, unsigned int note) {
+		return (state << 16) | ((channel & 0xff) << 8) | (note & 0xff);
+	}
+
+	static inline unsigned int key_state(uint32_t k) {
+		return k >> 16;
+	}
+
+	static inline unsigned int key_channel(uint32_t k) {
+		return (k >> 8) & 0xff;
+	}
+
+	unsigned int size() const {
+		return voices.size();
+	}
+
+	inline void update_key(unsigned int index) {
+		const voice &v = voices[index];
+		const uint32_t old_key = keys[index];
+		const uint32_t new_key = key(v.state, v.channel, v.note);
+		keys[index] = new_key;
+
+		const bool was_active = key_state(old_key) != voice::OFF;
+		const bool is_active = key_state(new_key) != voice::OFF;
+		const bool moved = key_channel(old_key) != key_channel(new_key);
+		if (was_active && (!is_active || moved)) unlink_channel(index, key_channel(old_key));
+		if (is_active && (!was_active || moved)) link_channel(index, key_channel(new_key));
+	}
+
+	//! The first active voice on channel or -1. Continue with channel_next
+	inline int first_on_channel(unsigned int channel) const {
+		return channel < key_channels ? channel_heads[channel] : -1;
+	}
+
+	inline bool active(unsigned int index) const {
+		return key_state(keys[index]) != voice::OFF;
+	}
+
+	inline bool any_active() const {
+		const uint32_t *k = &keys[0];
+		const unsigned int n = keys.size();
+
+		//! No early exit, so this is a plain reduction. It relies on OFF being 0
+		uint32_t states = 0;
+		for (unsigned int index = 0; index < n; ++index) {
+			states |= k[index];
+		}
+		return key_state(states) != voice::OFF;
+	}
+
+	//! Orders voices by the sample they read and then by their position in it
+	struct read_order {
+		const voice_pool &pool;
+
+		read_order(const voice_pool &pool) : pool(pool) { }
+
+		bool operator()(unsigned int a, unsigned int b) const {
+			const float *data_a = pool.generators[a]->hot.region.data_0;
+			const float *data_b = pool.generators[b]->hot.region.data_0;
+			if (data_a != data_b) return data_a < data_b;
+			return pool.voices[a].position < pool.voices[b].position;
+		}
+	};
+
+	//! Orders voices by the time since their note on at now, the youngest first
+	struct younger {
+		const voice_pool &pool;
+		const jack_nframes_t now;
+
+		younger(const voice_pool &pool, jack_nframes_t now) : pool(pool), now(now) { }
+
+		bool operator()(unsigned int a, unsigned int b) const {
+			return now - pool.voices[a].note_on_frame < now - pool.voices[b].note_on_frame;
+		}
+	};
+
+	/**
+		Fill order with the indices of the active voices, sorted so that voices
+		reading the same sample (layers, unison stacks, repeated hits) and nearby
+		regions of it are rendered one after the other. Returns the number of
+		active voices. This does not allocate. With sort false the voices stay in
+		slot order (for comparisons in the benchmark).
+	*/
+	unsigned int sort_active(bool sort = true) {
+		unsigned int count = 0;
+		for (unsigned int index = 0; index < size(); ++index) {
+			if (active(index)) order[count++] = index;
+		}
+		if (sort) std::sort(order.begin(), order.begin() + count, read_order(*this));
+		return count;
+	}
+
+	inline void link_channel(unsigned int index, unsigned int channel) {
+		int &head = channel_heads[channel];
+		channel_next[index] = head;
+		channel_prev[index] = -1;
+		if (head >= 0) channel_prev[head] = index;
+		head = index;
+	}
+
+	inline void unlink_channel(unsigned int index, unsigned int channel) {
+		const int prev = channel_prev[index];
+		if (prev == unlinked) return;
+
+		const int next = channel_next[index];
+		if (prev >= 0) channel_next[prev] = next;
+		else channel_heads[channel] = next;
+		if (next >= 0) channel_prev[next] = prev;
+
+		channel_prev[index] = unlinked;
+		channel_next[index] = -1;
+	}
+
+	//! Only call this in the process thread
+	void bind(unsigned int index, generator *gen) {
+		release(index);
+		++gen->bound_voices;
+		generators[index] = gen;
+	}
+
+	//! Only call this in the process thread
+	void release(unsigned int index) {
+		generator *g = generators[index];
+		if (0 == g) return;
+		//! Make sure we are done with the generator before heap::cleanup() can see it unused
+		__sync_synchronize();
+		--g->bound_voices;
+		generators[index] = 0;
+	}
+
+	//! Only call this in the process thread
+	void release_all() {
+		for (unsigned int index = 0; index < size(); ++index) {
+			release(index);
+		}
+	}
+};
+
+inline size_t disposable_memory(const voice_pool &p) {
+	return 
+		sizeof(voice_pool) 
+		+ vector_memory(p.voices) + vector_memory(p.generators) + vector_memory(p.keys) + vector_memory(p.order)
+		+ vector_memory(p.chains) + vector_memory(p.chain_next) + vector_memory(p.chain_prev)
+		+ vector_memory(p.channel_heads) + vector_memory(p.channel_next) + vector_memory(p.channel_prev);
+}
+
+typedef disposable<voice_pool> disposable_voice_pool;
+typedef boost::shared_ptr<disposable_voice_pool> disposable_voice_pool_ptr;
+
+#endif
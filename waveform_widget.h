@@ -29,7 +29,7 @@ struct waveform_widget : public QWidget {
 //! snap all sample/loop start/end points to the closest following zero crossing
 		inline void snap_to_zero(double sample_start, double sample_end, double loop_start, double loop_end) {
 			double thresh = 0.001;
-			unsigned int sample_length = gen->t.sample_->t.data_0.size();
+			unsigned int sample_length = gen->t.sample_->t.frames;
 			unsigned int i;
 
 	
@@ -38,7 +38,7 @@ struct waveform_widget : public QWidget {
 			unsigned int sstart = sample_length * sample_start;
 
 			for (i = sstart; i >= 0; --i) {
-				if (fabs(gen->t.sample_->t.data_0[i]) < thresh) {
+				if (fabs(gen->t.sample_->t.begin_0()[i]) < thresh) {
 					break;
 				}
 			}
@@ -47,7 +47,7 @@ struct waveform_widget : public QWidget {
 			unsigned int lstart = sample_length * loop_start;
 
 			for (i = lstart; i >= 0; --i) {
-				if (fabs(gen->t.sample_->t.data_0[i]) < thresh) {
+				if (fabs(gen->t.sample_->t.begin_0()[i]) < thresh) {
 					break;
 				}
 			}
@@ -57,7 +57,7 @@ struct waveform_widget : public QWidget {
 			unsigned int send = sample_length * sample_end;
 
 			for (i = send; i < sample_length; ++i) {
-				if (fabs(gen->t.sample_->t.data_0[i]) < thresh) {
+				if (fabs(gen->t.sample_->t.begin_0()[i]) < thresh) {
 					break;
 				}
 			}
@@ -66,17 +66,17 @@ struct waveform_widget : public QWidget {
 			unsigned int lend = sample_length * loop_end;
 
 			for (i = lend; i < sample_length; ++i) {
-				if (fabs(gen->t.sample_->t.data_0[i]) < thresh) {
+				if (fabs(gen->t.sample_->t.begin_0()[i]) < thresh) {
 					break;
 				}
 			}
 			loop_end = (double)i/sample_length;
 		
-			engine::get()->write_command(assign(gen->t.sample_start, sample_start));
-			engine::get()->write_command(assign(gen->t.sample_end, sample_end));
-			engine::get()->write_command(assign(gen->t.loop_start, loop_start));
-			engine::get()->write_command(assign(gen->t.loop_end, loop_end));
-			engine::get()->deferred_commands.write(boost::bind(&waveform_widget::update, this));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.sample_start, sample_start));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.sample_end, sample_end));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.loop_start, loop_start));
+			engine::get()->write_command(assign_parameter(gen->t, gen->t.loop_end, loop_end));
+			engine::get()->defer(boost::bind(&waveform_widget::update, this));
 		}
 		
 		waveform_widget(disposable_generator_ptr gen, QWidget *parent = 0) :
@@ -101,8 +101,8 @@ struct waveform_widget : public QWidget {
 			QVector<QPointF> points;
 			points.push_back(QPointF(0.0, height()-1));
 			for (unsigned int i = 0; i < n; ++i) {
-				unsigned int sample_index = (gen->t.sample_->t.data_0.size() - 1)*(double(i)/(double)n);
-				points.push_back(QPointF(width()*(double(i)/double(n)), height() * (1.0 - fabs(gen->t.sample_->t.data_0[sample_index]))));
+				unsigned int sample_index = (gen->t.sample_->t.frames - 1)*(double(i)/(double)n);
+				points.push_back(QPointF(width()*(double(i)/double(n)), height() * (1.0 - fabs(gen->t.sample_->t.begin_0()[sample_index]))));
 			}
 			painter.drawPolygon(&points[0], points.size(), Qt::OddEvenFill);
 
@@ -128,7 +128,7 @@ struct waveform_widget : public QWidget {
 								gen->t.loop_start
 					);
 					e->accept();
-					engine::get()->deferred_commands.write(boost::bind(
+					engine::get()->defer(boost::bind(
 						&waveform_widget::snap_to_zero, this, 
 							gen->t.sample_start, gen->t.sample_end, gen->t.loop_start, loop_end));
 
@@ -137,7 +137,7 @@ struct waveform_widget : public QWidget {
 					double sample_end = std::max((double)(e->x())/width(), gen->t.sample_start);
 					double loop_end = std::min(gen->t.sample_end, gen->t.loop_end);
 					e->accept();
-					engine::get()->deferred_commands.write(
+					engine::get()->defer(
 						boost::bind(&waveform_widget::snap_to_zero, this, 
 							gen->t.sample_start, sample_end, gen->t.loop_start, loop_end));
 				}
@@ -149,14 +149,14 @@ struct waveform_widget : public QWidget {
 				if (e->modifiers() & Qt::ShiftModifier) {
 					double loop_start = std::min(std::max((double)(e->x())/width(), gen->t.sample_start), gen->t.sample_end);
 					e->accept();
-					engine::get()->deferred_commands.write(
+					engine::get()->defer(
 						boost::bind(&waveform_widget::snap_to_zero, this, 
 							gen->t.sample_start, gen->t.sample_end, loop_start, gen->t.loop_end));
 				} else {
 					double sample_start = std::min((double)(e->x())/width(), gen->t.sample_end);
 					double loop_start = std::max(gen->t.sample_start, gen->t.loop_start);
 					e->accept();
-					engine::get()->deferred_commands.write(
+					engine::get()->defer(
 						boost::bind(&waveform_widget::snap_to_zero, this, 
 							sample_start, gen->t.sample_end, loop_start, gen->t.loop_end));
 				}
@@ -165,14 +165,14 @@ struct waveform_widget : public QWidget {
 				if (e->modifiers() & Qt::ShiftModifier) {
 					double loop_end = std::max(std::min((double)(e->x())/width(), gen->t.sample_end), gen->t.sample_start);
 					e->accept();
-					engine::get()->deferred_commands.write(
+					engine::get()->defer(
 						boost::bind(&waveform_widget::snap_to_zero, this, 
 							gen->t.sample_start, gen->t.sample_end, gen->t.loop_start, loop_end));
 				} else {
 					double sample_end = std::max((double)(e->x())/width(), gen->t.sample_start);
 					double loop_end = std::min(gen->t.sample_end, gen->t.loop_end);
 					e->accept();
-					engine::get()->deferred_commands.write(
+					engine::get()->defer(
 						boost::bind(&waveform_widget::snap_to_zero, this, 
 							gen->t.sample_start, sample_end, gen->t.loop_start, loop_end));
 				}